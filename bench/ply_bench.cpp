@@ -0,0 +1,380 @@
+#include "synthetic_ply.h"
+#include "../src/ply_mesh_data.h"
+#include "../external/tinyply/tinyply.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+#include <sys/resource.h>
+
+// Standalone benchmark of the Maya independent import and export path:
+// header parsing, body decoding, polygon building and writing, over a
+// matrix of synthetic files. Prints one json object per stage and line to
+// stdout (or --out), and a readable table to stderr. 
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock clock_type;
+
+	struct Options
+	{
+		std::vector<uint64_t>                sizes;
+		std::vector<SyntheticPly::Format>    formats;
+		std::vector<SyntheticPly::Topology>  topologies;
+		std::vector<std::string>             attributes;
+		unsigned int threads;
+		int          repeat;
+		std::string  directory;
+		std::string  output;
+		bool         keepFiles;
+	};
+
+	struct StageResult
+	{
+		double   seconds;
+		int64_t  peakRssKb;
+	};
+
+	std::vector<std::string> split(const std::string& text, char separator)
+	{
+		std::vector<std::string> parts;
+		std::stringstream ss(text);
+		std::string part;
+		while(std::getline(ss, part, separator))
+		{
+			if(!part.empty()) parts.push_back(part);
+		}
+		return parts;
+	}
+
+	void print_usage()
+	{
+		std::cerr <<
+			"usage: ply_bench [options]\n"
+			"  --sizes=1000,100000,1000000     vertex counts (1K to 100M)\n"
+			"  --formats=ascii,binary          ascii, binary (little endian), binary_be\n"
+			"  --topologies=triangles,quads,strips,points\n"
+			"  --attributes=none,all           none, normals, colors, uvs or all\n"
+			"  --threads=0                     decoding threads, 0 uses every core\n"
+			"  --repeat=3                      runs per stage, the fastest is reported\n"
+			"  --dir=.                         where the synthetic files are written\n"
+			"  --out=FILE                      json lines go to FILE instead of stdout\n"
+			"  --keep                          keep the synthetic files\n";
+	}
+
+	bool parse_options(int argc, char** argv, Options& options)
+	{
+		std::map<std::string, std::string> values;
+		values["sizes"]      = "1000,100000,1000000";
+		values["formats"]    = "ascii,binary";
+		values["topologies"] = "triangles,quads,strips,points";
+		values["attributes"] = "none,all";
+		values["threads"]    = "0";
+		values["repeat"]     = "3";
+		values["dir"]        = ".";
+		values["out"]        = "";
+		options.keepFiles = false;
+
+		for(int i=1; i<argc; ++i)
+		{
+			const std::string arg(argv[i]);
+			if(arg == "--keep")
+			{
+				options.keepFiles = true;
+				continue;
+			}
+			const size_t eq = arg.find('=');
+			if(arg.compare(0, 2, "--") != 0 || eq == std::string::npos || values.find(arg.substr(2, eq - 2)) == values.end())
+			{
+				return false;
+			}
+			values[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+		}
+
+		const std::vector<std::string> sizes = split(values["sizes"], ',');
+		for(size_t i=0; i<sizes.size(); ++i)
+		{
+			options.sizes.push_back(std::strtoull(sizes[i].c_str(), nullptr, 10));
+		}
+
+		const std::vector<std::string> formats = split(values["formats"], ',');
+		for(size_t i=0; i<formats.size(); ++i)
+		{
+			if(formats[i] == "ascii")          options.formats.push_back(SyntheticPly::kAscii);
+			else if(formats[i] == "binary")    options.formats.push_back(SyntheticPly::kBinaryLittleEndian);
+			else if(formats[i] == "binary_be") options.formats.push_back(SyntheticPly::kBinaryBigEndian);
+			else return false;
+		}
+
+		const std::vector<std::string> topologies = split(values["topologies"], ',');
+		for(size_t i=0; i<topologies.size(); ++i)
+		{
+			if(topologies[i] == "points")         options.topologies.push_back(SyntheticPly::kPoints);
+			else if(topologies[i] == "triangles") options.topologies.push_back(SyntheticPly::kTriangles);
+			else if(topologies[i] == "quads")     options.topologies.push_back(SyntheticPly::kQuads);
+			else if(topologies[i] == "strips")    options.topologies.push_back(SyntheticPly::kStrips);
+			else return false;
+		}
+
+		options.attributes = split(values["attributes"], ',');
+		for(size_t i=0; i<options.attributes.size(); ++i)
+		{
+			const std::string& a = options.attributes[i];
+			if(a != "none" && a != "normals" && a != "colors" && a != "uvs" && a != "all") return false;
+		}
+
+		options.threads   = static_cast<unsigned int>(std::atoi(values["threads"].c_str()));
+		options.repeat    = std::max(1, std::atoi(values["repeat"].c_str()));
+		options.directory = values["dir"];
+		options.output    = values["out"];
+		return !options.sizes.empty() && !options.formats.empty() && !options.topologies.empty() && !options.attributes.empty();
+	}
+
+	// Peak resident memory of a stage. Linux can reset the high water mark
+	// of a process; where it cannot, the peak of the whole run is reported. 
+	void reset_peak_rss()
+	{
+		std::ofstream clearRefs("/proc/self/clear_refs");
+		clearRefs << "5";
+	}
+
+	int64_t peak_rss_kb()
+	{
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while(std::getline(status, line))
+		{
+			if(line.compare(0, 6, "VmHWM:") == 0)
+			{
+				return std::atoll(line.c_str() + 6);
+			}
+		}
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return static_cast<int64_t>(usage.ru_maxrss);
+	}
+
+	// Runs a stage repeat times; body returns the seconds of its timed part. 
+	StageResult run_stage(int repeat, const std::function<double()>& body)
+	{
+		StageResult result = { 0.0, 0 };
+		for(int i=0; i<repeat; ++i)
+		{
+			reset_peak_rss();
+			const double seconds = body();
+			result.seconds   = (i == 0) ? seconds : std::min(result.seconds, seconds);
+			result.peakRssKb = std::max(result.peakRssKb, peak_rss_kb());
+		}
+		return result;
+	}
+
+	double seconds_since(clock_type::time_point start)
+	{
+		return std::chrono::duration<double>(clock_type::now() - start).count();
+	}
+
+	class Report
+	{
+	public:
+
+		Report(std::ostream& json) : json(json) {}
+
+		void add(const std::string& caseName, const std::string& stage, const SyntheticPlyStats& file, unsigned int threads, uint64_t bytes, uint64_t records, const StageResult& result)
+		{
+			const double seconds = std::max(result.seconds, 1e-9);
+			const double mbPerSecond = bytes / seconds / (1024.0 * 1024.0);
+			const double recordsPerSecond = records / seconds;
+
+			json << "{\"case\":\"" << caseName << "\",\"stage\":\"" << stage << "\""
+				 << ",\"vertices\":" << file.vertices << ",\"faces\":" << file.faces << ",\"fileBytes\":" << file.bytes
+				 << ",\"threads\":" << threads << ",\"bytes\":" << bytes << ",\"records\":" << records
+				 << ",\"seconds\":" << result.seconds << ",\"mbPerSecond\":" << mbPerSecond << ",\"recordsPerSecond\":" << recordsPerSecond
+				 << ",\"peakRssKb\":" << result.peakRssKb << "}" << std::endl;
+
+			char line[256];
+			snprintf(line, sizeof(line), "%-44s %-14s %10.3f ms %10.1f MB/s %12.3g rec/s %9lld KB\n",
+					 caseName.c_str(), stage.c_str(), result.seconds * 1000.0, mbPerSecond, recordsPerSecond, static_cast<long long>(result.peakRssKb));
+			std::cerr << line;
+		}
+
+	private:
+
+		std::ostream& json;
+	};
+
+	void read_mesh(const std::string& path, PlyMeshData& data, unsigned int threads)
+	{
+		std::ifstream is(path.c_str(), std::ios::binary);
+		tinyply::PlyFile file(is);
+		is.close();
+		request_mesh_data(file, data);
+		tinyply::MemoryMappedFile mappedFile(path);
+		file.read(mappedFile, threads);
+	}
+
+	void bench_case(const Options& options, const SyntheticPly& spec, const std::string& attributes, Report& report)
+	{
+		std::ostringstream name;
+		name << topology_name(spec.topology) << "/" << format_name(spec.format) << "/" << attributes << "/" << spec.vertexCount;
+		const std::string caseName = name.str();
+		const std::string path = options.directory + "/ply_bench_input.ply";
+		const std::string outputPath = options.directory + "/ply_bench_output.ply";
+		const unsigned int threads = options.threads;
+
+		SyntheticPlyStats file = { 0, 0, 0 };
+		StageResult generated = run_stage(1, [&]()
+		{
+			const clock_type::time_point start = clock_type::now();
+			file = write_synthetic_ply(spec, path);
+			return seconds_since(start);
+		});
+		const uint64_t records = file.vertices + file.faces;
+		report.add(caseName, "generate", file, 1, file.bytes, records, generated);
+
+		size_t headerSize = 0;
+		StageResult header = run_stage(options.repeat, [&]()
+		{
+			const clock_type::time_point start = clock_type::now();
+			std::ifstream is(path.c_str(), std::ios::binary);
+			tinyply::PlyFile ply(is);
+			headerSize = ply.get_header_size();
+			return seconds_since(start);
+		});
+		report.add(caseName, "parse_header", file, 1, headerSize, 1, header);
+
+		const uint64_t bodyBytes = file.bytes - headerSize;
+		StageResult mapped = run_stage(options.repeat, [&]()
+		{
+			PlyMeshData data;
+			const clock_type::time_point start = clock_type::now();
+			read_mesh(path, data, threads);
+			return seconds_since(start);
+		});
+		report.add(caseName, "read_mapped", file, threads, bodyBytes, records, mapped);
+
+		StageResult streamed = run_stage(options.repeat, [&]()
+		{
+			PlyMeshData data;
+			const clock_type::time_point start = clock_type::now();
+			std::ifstream is(path.c_str(), std::ios::binary);
+			tinyply::PlyFile ply(is);
+			request_mesh_data(ply, data);
+			ply.read(is, threads);
+			return seconds_since(start);
+		});
+		report.add(caseName, "read_stream", file, threads, bodyBytes, records, streamed);
+
+		PlyMeshData mesh;
+		read_mesh(path, mesh, threads);
+
+		if(spec.topology != SyntheticPly::kPoints)
+		{
+			const uint64_t indexBytes = (mesh.faces.size() + mesh.faceOffsets.size() + mesh.stripIndices.size()) * sizeof(int);
+			uint64_t polygonCount = 0;
+			StageResult polygons = run_stage(options.repeat, [&]()
+			{
+				PlyMeshData data;
+				data.faceCount     = mesh.faceCount;
+				data.tristripCount = mesh.tristripCount;
+				data.faceOffsets   = mesh.faceOffsets;
+				data.faces         = mesh.faces;
+				data.stripIndices  = mesh.stripIndices;
+				std::vector<int> polygonCounts;
+				std::vector<int> polygonConnects;
+				const clock_type::time_point start = clock_type::now();
+				polygonCount = build_polygons(data, polygonCounts, polygonConnects, threads);
+				return seconds_since(start);
+			});
+			report.add(caseName, "build_polygons", file, threads, indexBytes, polygonCount, polygons);
+		}
+
+		for(int ascii=0; ascii<2; ++ascii)
+		{
+			uint64_t writtenBytes = 0;
+			StageResult written = run_stage(options.repeat, [&]()
+			{
+				tinyply::PlyFile ply;
+				ply.add_properties_to_element("vertex", { "x", "y", "z" }, mesh.vertices);
+				if(!mesh.normals.empty()) ply.add_properties_to_element("vertex", { "nx", "ny", "nz" }, mesh.normals);
+				if(!mesh.colors.empty())  ply.add_properties_to_element("vertex", { "red", "green", "blue" }, mesh.colors);
+				if(!mesh.uvs.empty())     ply.add_properties_to_element("vertex", { "u", "v" }, mesh.uvs);
+				if(!mesh.faces.empty())
+				{
+					const int corners = (spec.topology == SyntheticPly::kQuads) ? 4 : 3;
+					ply.add_properties_to_element("face", { "vertex_indices" }, mesh.faces, corners, tinyply::PlyProperty::Type::UINT8);
+				}
+
+				const clock_type::time_point start = clock_type::now();
+				std::ofstream os(outputPath.c_str(), std::ios::binary | std::ios::trunc);
+				ply.write(os, ascii == 0);
+				os.flush();
+				writtenBytes = static_cast<uint64_t>(os.tellp());
+				return seconds_since(start);
+			});
+			report.add(caseName, ascii ? "write_ascii" : "write_binary", file, 1, writtenBytes, file.vertices + mesh.faceCount, written);
+		}
+
+		if(!options.keepFiles)
+		{
+			std::remove(path.c_str());
+			std::remove(outputPath.c_str());
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if(!parse_options(argc, argv, options))
+	{
+		print_usage();
+		return 2;
+	}
+
+	std::ofstream outputFile;
+	if(!options.output.empty())
+	{
+		outputFile.open(options.output.c_str(), std::ios::trunc);
+		if(!outputFile)
+		{
+			std::cerr << "cannot write " << options.output << std::endl;
+			return 1;
+		}
+	}
+	Report report(options.output.empty() ? std::cout : outputFile);
+
+	try
+	{
+		for(size_t t=0; t<options.topologies.size(); ++t)
+		for(size_t f=0; f<options.formats.size(); ++f)
+		for(size_t a=0; a<options.attributes.size(); ++a)
+		for(size_t s=0; s<options.sizes.size(); ++s)
+		{
+			const std::string& attributes = options.attributes[a];
+			SyntheticPly spec;
+			spec.vertexCount = options.sizes[s];
+			spec.format      = options.formats[f];
+			spec.topology    = options.topologies[t];
+			spec.normals     = attributes == "normals" || attributes == "all";
+			spec.colors      = attributes == "colors"  || attributes == "all";
+			spec.uvs         = attributes == "uvs"     || attributes == "all";
+			bench_case(options, spec, attributes, report);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Caught exception: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,269 @@
+#include "synthetic_ply.h"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	// Bytes collected before every write to the file. 
+	const size_t kBufferBytes = 1 << 20;
+
+	class BodyWriter
+	{
+	public:
+
+		BodyWriter(std::ofstream& os, SyntheticPly::Format format)
+			: os(os)
+			, ascii(format == SyntheticPly::kAscii)
+			, swap(format == SyntheticPly::kBinaryBigEndian)
+			, recordStart(true)
+		{
+			buffer.reserve(kBufferBytes + 64);
+		}
+
+		~BodyWriter()
+		{
+			flush();
+		}
+
+		void value(float v)
+		{
+			if(ascii)
+			{
+				char text[32];
+				append_text(text, snprintf(text, sizeof(text), "%g", v));
+			}
+			else
+			{
+				append_binary(&v, sizeof(v));
+			}
+		}
+
+		void value(int32_t v)
+		{
+			if(ascii)
+			{
+				char text[16];
+				append_text(text, snprintf(text, sizeof(text), "%d", v));
+			}
+			else
+			{
+				append_binary(&v, sizeof(v));
+			}
+		}
+
+		void value(uint8_t v)
+		{
+			if(ascii)
+			{
+				char text[8];
+				append_text(text, snprintf(text, sizeof(text), "%u", static_cast<unsigned int>(v)));
+			}
+			else
+			{
+				append_binary(&v, sizeof(v));
+			}
+		}
+
+		void end_record()
+		{
+			if(ascii) buffer.push_back('\n');
+			recordStart = true;
+		}
+
+		void flush()
+		{
+			if(buffer.empty()) return;
+			os.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			buffer.clear();
+		}
+
+	private:
+
+		void append_text(const char* text, int length)
+		{
+			if(buffer.size() >= kBufferBytes) flush();
+			if(!recordStart) buffer.push_back(' ');
+			buffer.insert(buffer.end(), text, text + length);
+			recordStart = false;
+		}
+
+		void append_binary(const void* v, size_t bytes)
+		{
+			if(buffer.size() >= kBufferBytes) flush();
+			const char* p = static_cast<const char*>(v);
+			const size_t at = buffer.size();
+			buffer.insert(buffer.end(), p, p + bytes);
+			if(swap) std::reverse(buffer.begin() + at, buffer.end());
+			recordStart = false;
+		}
+
+		std::ofstream&    os;
+		std::vector<char> buffer;
+		bool ascii;
+		bool swap;
+		bool recordStart;
+	};
+}
+
+const char* format_name(SyntheticPly::Format format)
+{
+	switch(format)
+	{
+	case SyntheticPly::kAscii:              return "ascii";
+	case SyntheticPly::kBinaryLittleEndian: return "binary_little_endian";
+	case SyntheticPly::kBinaryBigEndian:    return "binary_big_endian";
+	}
+	return "";
+}
+
+const char* topology_name(SyntheticPly::Topology topology)
+{
+	switch(topology)
+	{
+	case SyntheticPly::kPoints:    return "points";
+	case SyntheticPly::kTriangles: return "triangles";
+	case SyntheticPly::kQuads:     return "quads";
+	case SyntheticPly::kStrips:    return "strips";
+	}
+	return "";
+}
+
+SyntheticPlyStats write_synthetic_ply(const SyntheticPly& spec, const std::string& path)
+{
+	// The grid is as square as the vertex count allows. 
+	const uint64_t width  = std::max<uint64_t>(2, static_cast<uint64_t>(std::ceil(std::sqrt(static_cast<double>(spec.vertexCount)))));
+	const uint64_t height = std::max<uint64_t>(2, spec.vertexCount / width);
+	const uint64_t cells  = (width - 1) * (height - 1);
+
+	SyntheticPlyStats stats;
+	stats.vertices = width * height;
+	stats.faces    = 0;
+	switch(spec.topology)
+	{
+	case SyntheticPly::kPoints:    break;
+	case SyntheticPly::kTriangles: stats.faces = cells * 2; break;
+	case SyntheticPly::kQuads:     stats.faces = cells; break;
+	case SyntheticPly::kStrips:    stats.faces = 1; break;
+	}
+
+	std::ofstream os(path.c_str(), std::ios::binary | std::ios::trunc);
+	if(!os)
+	{
+		throw std::runtime_error("cannot create " + path);
+	}
+
+	std::ostringstream header;
+	header << "ply\n";
+	header << "format " << format_name(spec.format) << " 1.0\n";
+	header << "comment synthetic " << topology_name(spec.topology) << " grid " << width << "x" << height << "\n";
+	header << "element vertex " << stats.vertices << "\n";
+	header << "property float x\nproperty float y\nproperty float z\n";
+	if(spec.normals) header << "property float nx\nproperty float ny\nproperty float nz\n";
+	if(spec.colors)  header << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+	if(spec.uvs)     header << "property float u\nproperty float v\n";
+	if(spec.topology == SyntheticPly::kTriangles || spec.topology == SyntheticPly::kQuads)
+	{
+		header << "element face " << stats.faces << "\n";
+		header << "property list uchar int vertex_indices\n";
+	}
+	else if(spec.topology == SyntheticPly::kStrips)
+	{
+		header << "element tristrips 1\n";
+		header << "property list int int vertex_indices\n";
+	}
+	header << "end_header\n";
+	const std::string headerText = header.str();
+	os.write(headerText.data(), static_cast<std::streamsize>(headerText.size()));
+
+	{
+		BodyWriter body(os, spec.format);
+		for(uint64_t y=0; y<height; ++y)
+		{
+			for(uint64_t x=0; x<width; ++x)
+			{
+				const float z = 0.25f * static_cast<float>((x * 7 + y * 13) % 17);
+				body.value(static_cast<float>(x));
+				body.value(static_cast<float>(y));
+				body.value(z);
+				if(spec.normals)
+				{
+					body.value(0.0f);
+					body.value(0.0f);
+					body.value(1.0f);
+				}
+				if(spec.colors)
+				{
+					body.value(static_cast<uint8_t>(x * 255 / (width - 1)));
+					body.value(static_cast<uint8_t>(y * 255 / (height - 1)));
+					body.value(static_cast<uint8_t>((x + y) & 255));
+				}
+				if(spec.uvs)
+				{
+					body.value(static_cast<float>(x) / (width - 1));
+					body.value(static_cast<float>(y) / (height - 1));
+				}
+				body.end_record();
+			}
+		}
+
+		if(spec.topology == SyntheticPly::kTriangles || spec.topology == SyntheticPly::kQuads)
+		{
+			const bool quads = spec.topology == SyntheticPly::kQuads;
+			for(uint64_t y=0; y+1<height; ++y)
+			{
+				for(uint64_t x=0; x+1<width; ++x)
+				{
+					const int32_t v0 = static_cast<int32_t>(y * width + x);
+					const int32_t v1 = v0 + 1;
+					const int32_t v2 = static_cast<int32_t>(v1 + width);
+					const int32_t v3 = static_cast<int32_t>(v0 + width);
+					if(quads)
+					{
+						body.value(static_cast<uint8_t>(4));
+						body.value(v0); body.value(v1); body.value(v2); body.value(v3);
+						body.end_record();
+					}
+					else
+					{
+						body.value(static_cast<uint8_t>(3));
+						body.value(v0); body.value(v1); body.value(v2);
+						body.end_record();
+						body.value(static_cast<uint8_t>(3));
+						body.value(v0); body.value(v2); body.value(v3);
+						body.end_record();
+					}
+				}
+			}
+		}
+		else if(spec.topology == SyntheticPly::kStrips)
+		{
+			// One strip per row of cells, each ended by -1. 
+			const uint64_t indexCount = (height - 1) * (width * 2 + 1);
+			body.value(static_cast<int32_t>(indexCount));
+			for(uint64_t y=0; y+1<height; ++y)
+			{
+				for(uint64_t x=0; x<width; ++x)
+				{
+					body.value(static_cast<int32_t>((y + 1) * width + x));
+					body.value(static_cast<int32_t>(y * width + x));
+				}
+				body.value(static_cast<int32_t>(-1));
+			}
+			body.end_record();
+		}
+	}
+
+	stats.bytes = static_cast<uint64_t>(os.tellp());
+	if(!os)
+	{
+		throw std::runtime_error("failed to write " + path);
+	}
+	return stats;
+}
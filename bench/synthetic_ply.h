@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// Describes a synthetic ply: a height field grid of about vertexCount
+// vertices, meshed as triangles, quads or row strips, or left as points. 
+struct SyntheticPly
+{
+	enum Format
+	{
+		kAscii,
+		kBinaryLittleEndian,
+		kBinaryBigEndian
+	};
+
+	enum Topology
+	{
+		kPoints,
+		kTriangles,
+		kQuads,
+		kStrips
+	};
+
+	SyntheticPly() : vertexCount(0), format(kBinaryLittleEndian), topology(kTriangles), normals(false), colors(false), uvs(false) {}
+
+	uint64_t vertexCount;
+	Format   format;
+	Topology topology;
+	bool     normals;	// float nx ny nz
+	bool     colors;	// uchar red green blue
+	bool     uvs;		// float u v
+};
+
+struct SyntheticPlyStats
+{
+	uint64_t vertices;
+	uint64_t faces;		// faces, or strip records
+	uint64_t bytes;		// file size
+};
+
+// Writes the file a buffer at a time, without going through tinyply, so
+// the generator never depends on the code it benchmarks. Throws
+// std::runtime_error when the file cannot be written. 
+SyntheticPlyStats write_synthetic_ply(const SyntheticPly& spec, const std::string& path);
+
+const char* format_name(SyntheticPly::Format format);
+const char* topology_name(SyntheticPly::Topology topology);
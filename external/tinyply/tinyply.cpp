@@ -6,9 +6,954 @@
 
 #include "tinyply.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <locale>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define TINYPLY_HAS_SSE2 1
+    #include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+    #define TINYPLY_HAS_AVX2 1
+    #include <immintrin.h>
+#endif
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
 using namespace tinyply;
 using namespace std;
 
+namespace
+{
+    ///////////////////
+    // Byte swapping //
+    ///////////////////
+    
+    inline void byteswap_scalar(uint8_t * data, size_t count, int width)
+    {
+        for (size_t i = 0; i < count; ++i, data += width)
+            std::reverse(data, data + width);
+    }
+    
+    // Reverses the bytes of `count` consecutive scalars of `width` bytes in
+    // place, a whole register of scalars per step.
+    void byteswap_block(uint8_t * data, size_t count, int width)
+    {
+        if (width <= 1) return;
+        size_t bytes = count * width;
+        
+#if defined(TINYPLY_HAS_AVX2)
+        {
+            const __m256i mask2 = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+            const __m256i mask4 = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+            const __m256i mask8 = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+            const __m256i mask = (width == 2) ? mask2 : (width == 4) ? mask4 : mask8;
+            for (; bytes >= 32; bytes -= 32, data += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(data), _mm256_shuffle_epi8(v, mask));
+            }
+        }
+#endif
+        
+#if defined(TINYPLY_HAS_SSE2)
+        for (; bytes >= 16; bytes -= 16, data += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            if (width == 4)
+            {
+                v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+            }
+            else if (width == 8)
+            {
+                v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1B), 0x1B);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(data), v);
+        }
+#endif
+        
+        byteswap_scalar(data, bytes / width, width);
+    }
+    
+    // Swaps the values a cursor received between two byte offsets.
+    inline void byteswap_cursor(DataCursor & cursor, size_t from, size_t to)
+    {
+        const int stride = type_stride(cursor.type);
+        byteswap_block(cursor.data + from, (to - from) / stride, stride);
+    }
+    
+    inline uint32_t read_list_count(PlyProperty::Type t, const uint8_t * src, bool bigEndian = false)
+    {
+        uint8_t raw[4];
+        if (bigEndian)
+        {
+            const int stride = type_stride(t);
+            std::reverse_copy(src, src + stride, raw);
+            src = raw;
+        }
+        switch (t)
+        {
+            case PlyProperty::Type::INT8:       return static_cast<uint32_t>(*reinterpret_cast<const int8_t *>(src));
+            case PlyProperty::Type::UINT8:      return *src;
+            case PlyProperty::Type::INT16:      { int16_t v;  memcpy(&v, src, sizeof(v)); return static_cast<uint32_t>(v); }
+            case PlyProperty::Type::UINT16:     { uint16_t v; memcpy(&v, src, sizeof(v)); return v; }
+            case PlyProperty::Type::INT32:      { int32_t v;  memcpy(&v, src, sizeof(v)); return static_cast<uint32_t>(v); }
+            case PlyProperty::Type::UINT32:     { uint32_t v; memcpy(&v, src, sizeof(v)); return v; }
+            default: throw std::invalid_argument("invalid list count type");
+        }
+    }
+    
+    ///////////////////////////////
+    // Strided copy (de)interleave //
+    ///////////////////////////////
+    
+    template<size_t N>
+    inline void copy_records_n(uint8_t * dst, size_t dstStride, const uint8_t * src, size_t srcStride, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i, dst += dstStride, src += srcStride) memcpy(dst, src, N);
+    }
+    
+    inline void copy_records_scalar(uint8_t * dst, size_t dstStride, const uint8_t * src, size_t srcStride, size_t count, size_t bytes)
+    {
+        switch (bytes)
+        {
+            case 1:  copy_records_n<1>(dst, dstStride, src, srcStride, count);  break;
+            case 2:  copy_records_n<2>(dst, dstStride, src, srcStride, count);  break;
+            case 3:  copy_records_n<3>(dst, dstStride, src, srcStride, count);  break;
+            case 4:  copy_records_n<4>(dst, dstStride, src, srcStride, count);  break;
+            case 6:  copy_records_n<6>(dst, dstStride, src, srcStride, count);  break;
+            case 8:  copy_records_n<8>(dst, dstStride, src, srcStride, count);  break;
+            case 12: copy_records_n<12>(dst, dstStride, src, srcStride, count); break;
+            case 16: copy_records_n<16>(dst, dstStride, src, srcStride, count); break;
+            case 24: copy_records_n<24>(dst, dstStride, src, srcStride, count); break;
+            default:
+                for (size_t i = 0; i < count; ++i, dst += dstStride, src += srcStride) memcpy(dst, src, bytes);
+        }
+    }
+    
+    // Number of strided positions, starting at p, from which `width` bytes can
+    // be accessed without crossing limit.
+    inline size_t accessible_count(const uint8_t * p, const uint8_t * limit, size_t stride, size_t width)
+    {
+        if (limit < p || static_cast<size_t>(limit - p) < width) return 0;
+        return (static_cast<size_t>(limit - p) - width) / stride + 1;
+    }
+    
+    // Copies `bytes` from each of `count` records of srcStride into slots of
+    // dstStride. The vector paths move a full register per record and let the
+    // store spill into the following slot, which the next iteration rewrites;
+    // dstLimit bounds the bytes that may be clobbered that way (pass dst to
+    // disable the vector paths when other runs share the slot).
+    void copy_strided(uint8_t * dst, size_t dstStride, const uint8_t * src, size_t srcStride, size_t count, size_t bytes,
+                      const uint8_t * srcLimit, const uint8_t * dstLimit)
+    {
+        if (count == 0 || bytes == 0) return;
+        
+        if (bytes == srcStride && bytes == dstStride)
+        {
+            memcpy(dst, src, count * bytes);
+            return;
+        }
+        
+        size_t done = 0;
+        
+#if defined(TINYPLY_HAS_AVX2)
+        if (bytes == 4 && dstStride == 4 && srcStride * 8 < 0x7fffffff)
+        {
+            // Single 32-bit property: gather eight records per iteration
+            const int s = static_cast<int>(srcStride);
+            const __m256i index = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+            for (; done + 8 <= count; done += 8)
+            {
+                __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int *>(src + done * srcStride), index, 1);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + done * dstStride), v);
+            }
+        }
+        else if (bytes > 16 && bytes <= 32)
+        {
+            const size_t n = std::min(count, std::min(accessible_count(src, srcLimit, srcStride, 32), accessible_count(dst, dstLimit, dstStride, 32)));
+            for (; done < n; ++done)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + done * srcStride));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + done * dstStride), v);
+            }
+        }
+#endif
+        
+#if defined(TINYPLY_HAS_SSE2)
+        if (bytes <= 16)
+        {
+            const size_t n = std::min(count, std::min(accessible_count(src, srcLimit, srcStride, 16), accessible_count(dst, dstLimit, dstStride, 16)));
+            for (; done < n; ++done)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + done * srcStride));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + done * dstStride), v);
+            }
+        }
+#endif
+        
+        copy_records_scalar(dst + done * dstStride, dstStride, src + done * srcStride, srcStride, count - done, bytes);
+    }
+    
+    ////////////////////////
+    // Value conversions //
+    ////////////////////////
+    
+    template<typename T, bool Swap>
+    inline T load_value(const uint8_t * src)
+    {
+        uint8_t raw[sizeof(T)];
+        memcpy(raw, src, sizeof(T));
+        if (Swap) std::reverse(raw, raw + sizeof(T));
+        T value;
+        memcpy(&value, raw, sizeof(T));
+        return value;
+    }
+    
+    // Reals going to integers are rounded to nearest and clamped to the
+    // destination range instead of overflowing.
+    template<typename Dst>
+    inline Dst from_real(double v)
+    {
+        if (!std::numeric_limits<Dst>::is_integer) return static_cast<Dst>(v);
+        const double lo = static_cast<double>(std::numeric_limits<Dst>::lowest());
+        const double hi = static_cast<double>(std::numeric_limits<Dst>::max());
+        v = (v != v) ? 0.0 : (v < lo ? lo : (v > hi ? hi : v));
+        return static_cast<Dst>(v < 0.0 ? v - 0.5 : v + 0.5);
+    }
+    
+    // One instance per (source, destination, swap, scale) combination, so the
+    // inner loop carries no type dispatch or branches and can be vectorized.
+    // Integers going to integers convert as static_cast does.
+    template<typename Src, typename Dst, bool Swap, bool Scaled>
+    void convert_records(uint8_t * dst, size_t dstStride, const uint8_t * src, size_t srcStride, size_t records, uint32_t values, double scale, double bias)
+    {
+        const bool viaReal = Scaled || !std::numeric_limits<Src>::is_integer || !std::numeric_limits<Dst>::is_integer;
+        for (size_t r = 0; r < records; ++r, dst += dstStride, src += srcStride)
+        {
+            for (uint32_t i = 0; i < values; ++i)
+            {
+                const Src value = load_value<Src, Swap>(src + i * sizeof(Src));
+                Dst result;
+                if (viaReal) result = from_real<Dst>(Scaled ? value * scale + bias : static_cast<double>(value));
+                else result = static_cast<Dst>(value);
+                memcpy(dst + i * sizeof(Dst), &result, sizeof(Dst));
+            }
+        }
+    }
+    
+    template<typename Src, typename Dst>
+    void convert_values(uint8_t * dst, size_t dstStride, const uint8_t * src, size_t srcStride, size_t records, uint32_t values, const ValueConversion & c)
+    {
+        if (c.swap)
+        {
+            if (c.scaled) convert_records<Src, Dst, true, true>(dst, dstStride, src, srcStride, records, values, c.scale, c.bias);
+            else convert_records<Src, Dst, true, false>(dst, dstStride, src, srcStride, records, values, c.scale, c.bias);
+        }
+        else
+        {
+            if (c.scaled) convert_records<Src, Dst, false, true>(dst, dstStride, src, srcStride, records, values, c.scale, c.bias);
+            else convert_records<Src, Dst, false, false>(dst, dstStride, src, srcStride, records, values, c.scale, c.bias);
+        }
+    }
+    
+    template<typename Src>
+    ConvertFunction select_conversion_from(PlyProperty::Type dst)
+    {
+        switch (dst)
+        {
+            case PlyProperty::Type::INT8:       return &convert_values<Src, int8_t>;
+            case PlyProperty::Type::UINT8:      return &convert_values<Src, uint8_t>;
+            case PlyProperty::Type::INT16:      return &convert_values<Src, int16_t>;
+            case PlyProperty::Type::UINT16:     return &convert_values<Src, uint16_t>;
+            case PlyProperty::Type::INT32:      return &convert_values<Src, int32_t>;
+            case PlyProperty::Type::UINT32:     return &convert_values<Src, uint32_t>;
+            case PlyProperty::Type::FLOAT32:    return &convert_values<Src, float>;
+            case PlyProperty::Type::FLOAT64:    return &convert_values<Src, double>;
+            default: throw std::invalid_argument("invalid destination type");
+        }
+    }
+    
+    ConvertFunction select_conversion(PlyProperty::Type src, PlyProperty::Type dst)
+    {
+        switch (src)
+        {
+            case PlyProperty::Type::INT8:       return select_conversion_from<int8_t>(dst);
+            case PlyProperty::Type::UINT8:      return select_conversion_from<uint8_t>(dst);
+            case PlyProperty::Type::INT16:      return select_conversion_from<int16_t>(dst);
+            case PlyProperty::Type::UINT16:     return select_conversion_from<uint16_t>(dst);
+            case PlyProperty::Type::INT32:      return select_conversion_from<int32_t>(dst);
+            case PlyProperty::Type::UINT32:     return select_conversion_from<uint32_t>(dst);
+            case PlyProperty::Type::FLOAT32:    return select_conversion_from<float>(dst);
+            case PlyProperty::Type::FLOAT64:    return select_conversion_from<double>(dst);
+            default: throw std::invalid_argument("invalid ply property");
+        }
+    }
+    
+    // Decodes one value or list into a cursor, converting when the plan says so.
+    inline void decode_values(const PropertyReadPlan & p, uint8_t * dst, const uint8_t * src, uint32_t values)
+    {
+        if (p.conversion.convert) p.conversion.convert(dst, 0, src, 0, 1, values, p.conversion);
+        else memcpy(dst, src, static_cast<size_t>(values) * type_stride(p.property->propertyType));
+    }
+    
+    // Decodes records [first, first + count) of a fixed-stride element whose
+    // body starts at body. Every record lands in its own slot of each cursor,
+    // so disjoint ranges can be decoded independently.
+    void decode_fixed_records(const ElementReadPlan & plan, const uint8_t * body, const uint8_t * srcLimit, size_t first, size_t count)
+    {
+        const uint8_t * src = body + first * plan.recordStride;
+        for (auto & run : plan.runs)
+        {
+            const CursorPlan & c = plan.cursors[run.cursorIndex];
+            uint8_t * dst = c.cursor->data + c.baseOffset + first * c.recordBytes + run.dstOffset;
+            const uint8_t * dstLimit = (c.runCount == 1) ? dst + count * c.recordBytes : dst;
+            copy_strided(dst, c.recordBytes, src + run.srcOffset, plan.recordStride, count, run.bytes, srcLimit, dstLimit);
+        }
+        for (auto & run : plan.conversions)
+        {
+            const CursorPlan & c = plan.cursors[run.cursorIndex];
+            uint8_t * dst = c.cursor->data + c.baseOffset + first * c.recordBytes + run.dstOffset;
+            run.conversion.convert(dst, c.recordBytes, src + run.srcOffset, plan.recordStride, count, run.values, run.conversion);
+        }
+    }
+    
+    ////////////////////////
+    // Ascii body scanning //
+    ////////////////////////
+    
+    const size_t kMinAsciiRecordsPerTask = 1 << 13;
+    
+    inline bool is_ascii_space(char c)
+    {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+    
+    inline bool is_ascii_digit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+    
+    inline unsigned int popcount16(unsigned int x)
+    {
+        x = x - ((x >> 1) & 0x5555);
+        x = (x & 0x3333) + ((x >> 2) & 0x3333);
+        x = (x + (x >> 4)) & 0x0f0f;
+        return (x + (x >> 8)) & 0x1f;
+    }
+    
+    inline const char * skip_ascii_space(const char * p, const char * end)
+    {
+        while (p < end && is_ascii_space(*p)) ++p;
+        return p;
+    }
+    
+    // First byte at or after p that ends a token (any control or space byte)
+    inline const char * find_token_end(const char * p, const char * end)
+    {
+#if defined(TINYPLY_HAS_SSE2)
+        const __m128i space = _mm_set1_epi8(' ');
+        while (end - p >= 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, space), space));
+            if (mask)
+            {
+                while (!is_ascii_space(*p) && static_cast<unsigned char>(*p) > ' ') ++p;
+                return p;
+            }
+            p += 16;
+        }
+#endif
+        while (p < end && static_cast<unsigned char>(*p) > ' ') ++p;
+        return p;
+    }
+    
+    inline const char * next_token(const char * p, const char * end)
+    {
+        p = skip_ascii_space(p, end);
+        if (p == end) throw std::runtime_error("unexpected end of ascii ply body");
+        return p;
+    }
+    
+    // Walks `lines` newlines from p and returns the position just past the
+    // last one (or end when the final line is unterminated). The start of every
+    // `every`-th line is appended to starts, beginning with p itself.
+    const char * scan_lines(const char * p, const char * end, size_t lines, size_t every, std::vector<const char *> & starts)
+    {
+        starts.push_back(p);
+        size_t counted = 0;
+        while (counted < lines)
+        {
+            const size_t target = std::min(lines, (counted / every + 1) * every);
+#if defined(TINYPLY_HAS_SSE2)
+            const __m128i newline = _mm_set1_epi8('\n');
+            while (end - p >= 16)
+            {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                const unsigned int n = popcount16(static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline))));
+                if (counted + n >= target) break;
+                counted += n;
+                p += 16;
+            }
+#endif
+            while (p < end && counted < target)
+            {
+                if (*p++ == '\n') ++counted;
+            }
+            if (p == end && counted < target)
+            {
+                if (counted + 1 == lines) return end;
+                throw std::runtime_error("unexpected end of ascii ply body");
+            }
+            if (counted % every == 0 && counted < lines) starts.push_back(p);
+        }
+        return p;
+    }
+    
+    //////////////////////////
+    // Ascii number parsing //
+    //////////////////////////
+    
+    // Integers follow num_get: out of range values saturate and a leading '-'
+    // on an unsigned type wraps around.
+    template<typename T>
+    const char * parse_ascii_integer(const char * p, const char * end, T & out)
+    {
+        p = next_token(p, end);
+        bool negative = false;
+        if (*p == '-' || *p == '+')
+        {
+            negative = (*p == '-');
+            ++p;
+        }
+        if (p == end || !is_ascii_digit(*p))
+            throw std::runtime_error("malformed integer in ascii ply body");
+        
+        uint64_t value = 0;
+        bool overflow = false;
+        for (; p < end && is_ascii_digit(*p); ++p)
+        {
+            const unsigned int digit = *p - '0';
+            if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10) overflow = true;
+            else value = value * 10 + digit;
+        }
+        
+        const uint64_t maxValue = static_cast<uint64_t>(std::numeric_limits<T>::max());
+        if (std::numeric_limits<T>::is_signed)
+        {
+            const uint64_t minMagnitude = maxValue + 1;
+            if (negative) out = (overflow || value >= minMagnitude) ? std::numeric_limits<T>::min() : static_cast<T>(-static_cast<int64_t>(value));
+            else out = (overflow || value > maxValue) ? std::numeric_limits<T>::max() : static_cast<T>(value);
+        }
+        else
+        {
+            if (overflow || value > maxValue) out = std::numeric_limits<T>::max();
+            else out = negative ? static_cast<T>(0 - static_cast<T>(value)) : static_cast<T>(value);
+        }
+        return find_token_end(p, end);
+    }
+    
+    const double kExactPowersOf10[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    
+    // Splits a plain decimal token into sign, up to 19 significant digits and
+    // a power of ten. Returns false for anything else (hex, inf, nan, ...).
+    bool parse_decimal(const char * p, const char * end, bool & negative, uint64_t & mantissa, int & exponent)
+    {
+        negative = false;
+        mantissa = 0;
+        exponent = 0;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = (*p == '-');
+            ++p;
+        }
+        
+        int significant = 0;
+        bool anyDigit = false;
+        for (; p < end && is_ascii_digit(*p); ++p)
+        {
+            anyDigit = true;
+            if (mantissa == 0 && *p == '0') continue;
+            if (++significant > 19) return false;
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && is_ascii_digit(*p); ++p)
+            {
+                anyDigit = true;
+                --exponent;
+                if (mantissa == 0 && *p == '0') continue;
+                if (++significant > 19) return false;
+                mantissa = mantissa * 10 + (*p - '0');
+            }
+        }
+        if (!anyDigit) return false;
+        
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negativeExponent = (*p == '-');
+                ++p;
+            }
+            if (p == end || !is_ascii_digit(*p)) return false;
+            int e = 0;
+            for (; p < end && is_ascii_digit(*p); ++p)
+            {
+                if (e < 10000) e = e * 10 + (*p - '0');
+            }
+            exponent += negativeExponent ? -e : e;
+        }
+        return p == end;
+    }
+    
+    // Exact when both the mantissa and the power of ten are representable,
+    // since the single multiply or divide is then correctly rounded.
+    inline bool decimal_to_double(uint64_t mantissa, int exponent, double & out)
+    {
+        if (mantissa == 0) { out = 0.0; return true; }
+        if (mantissa > (uint64_t(1) << 53) || exponent < -22 || exponent > 22) return false;
+        const double m = static_cast<double>(mantissa);
+        out = (exponent < 0) ? m / kExactPowersOf10[-exponent] : m * kExactPowersOf10[exponent];
+        return true;
+    }
+    
+    inline bool parse_real_fast(const char * p, const char * end, double & out)
+    {
+        bool negative;
+        uint64_t mantissa;
+        int exponent;
+        if (!parse_decimal(p, end, negative, mantissa, exponent) || !decimal_to_double(mantissa, exponent, out)) return false;
+        if (negative) out = -out;
+        return true;
+    }
+    
+    inline bool parse_real_fast(const char * p, const char * end, float & out)
+    {
+        bool negative;
+        uint64_t mantissa;
+        int exponent;
+        if (!parse_decimal(p, end, negative, mantissa, exponent)) return false;
+        
+        if (mantissa <= (uint64_t(1) << 24) && exponent >= -10 && exponent <= 10)
+        {
+            const float m = static_cast<float>(mantissa);
+            const float scale = static_cast<float>(kExactPowersOf10[exponent < 0 ? -exponent : exponent]);
+            out = (exponent < 0) ? m / scale : m * scale;
+        }
+        else
+        {
+            // Rounding the correctly rounded double to float only differs from
+            // rounding the decimal directly when the double sits exactly on a
+            // float midpoint, so those (and non-normal floats) take the slow path.
+            double d;
+            if (!decimal_to_double(mantissa, exponent, d)) return false;
+            if (d != 0.0 && (d < std::numeric_limits<float>::min() || d > std::numeric_limits<float>::max())) return false;
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(bits));
+            if ((bits & ((uint64_t(1) << 29) - 1)) == (uint64_t(1) << 28)) return false;
+            out = static_cast<float>(d);
+        }
+        if (negative) out = -out;
+        return true;
+    }
+    
+    template<typename T>
+    const char * parse_ascii_real(const char * p, const char * end, T & out)
+    {
+        p = next_token(p, end);
+        const char * tokenEnd = find_token_end(p, end);
+        if (!parse_real_fast(p, tokenEnd, out))
+        {
+            std::istringstream ss(std::string(p, tokenEnd));
+            ss.imbue(std::locale::classic());
+            out = ply_read_ascii<T>(ss);
+        }
+        return tokenEnd;
+    }
+    
+    // Chars are parsed through int, so they read as numbers rather than characters.
+    const char * parse_ascii_value(PlyProperty::Type t, const char * p, const char * end, uint8_t * dest)
+    {
+        switch (t)
+        {
+            case PlyProperty::Type::INT8:       { int32_t v;  p = parse_ascii_integer(p, end, v); *reinterpret_cast<int8_t *>(dest) = static_cast<int8_t>(v); return p; }
+            case PlyProperty::Type::UINT8:      { uint32_t v; p = parse_ascii_integer(p, end, v); *dest = static_cast<uint8_t>(v); return p; }
+            case PlyProperty::Type::INT16:      { int16_t v;  p = parse_ascii_integer(p, end, v); memcpy(dest, &v, sizeof(v)); return p; }
+            case PlyProperty::Type::UINT16:     { uint16_t v; p = parse_ascii_integer(p, end, v); memcpy(dest, &v, sizeof(v)); return p; }
+            case PlyProperty::Type::INT32:      { int32_t v;  p = parse_ascii_integer(p, end, v); memcpy(dest, &v, sizeof(v)); return p; }
+            case PlyProperty::Type::UINT32:     { uint32_t v; p = parse_ascii_integer(p, end, v); memcpy(dest, &v, sizeof(v)); return p; }
+            case PlyProperty::Type::FLOAT32:    { float v;    p = parse_ascii_real(p, end, v);    memcpy(dest, &v, sizeof(v)); return p; }
+            case PlyProperty::Type::FLOAT64:    { double v;   p = parse_ascii_real(p, end, v);    memcpy(dest, &v, sizeof(v)); return p; }
+            default: throw std::invalid_argument("invalid ply property");
+        }
+    }
+    
+    inline const char * parse_ascii_list_count(PlyProperty::Type t, const char * p, const char * end, uint32_t & count)
+    {
+        uint8_t raw[8] = { 0 };
+        p = parse_ascii_value(t, p, end, raw);
+        count = read_list_count(t, raw);
+        return p;
+    }
+    
+    inline const char * skip_ascii_token(const char * p, const char * end)
+    {
+        return find_token_end(next_token(p, end), end);
+    }
+    
+    // Walks `count` records. With Decode set every requested value is parsed
+    // into its cursor at offsets[cursorIndex]; otherwise only the bytes each
+    // cursor would receive are added to offsets.
+    template<bool Decode>
+    const char * walk_ascii_records(const ElementReadPlan & plan, const char * p, const char * end, size_t first, size_t count, size_t * offsets)
+    {
+        for (size_t record = first; record < first + count; ++record)
+        {
+            for (auto & prop : plan.properties)
+            {
+                const PlyProperty & property = *prop.property;
+                const size_t stride = prop.cursor ? type_stride(prop.cursor->type) : 0;
+                uint32_t values = 1;
+                if (property.isList) p = parse_ascii_list_count(property.listType, p, end, values);
+                if (prop.cursor && Decode)
+                {
+                    if (property.isList && prop.cursor->listOffsets) (*prop.cursor->listOffsets)[record + 1] = values;
+                    size_t & offset = offsets[prop.cursorIndex];
+                    for (uint32_t i = 0; i < values; ++i, offset += stride)
+                    {
+                        if (prop.conversion.convert)
+                        {
+                            uint8_t raw[8];
+                            p = parse_ascii_value(property.propertyType, p, end, raw);
+                            prop.conversion.convert(prop.cursor->data + offset, 0, raw, 0, 1, 1, prop.conversion);
+                        }
+                        else p = parse_ascii_value(property.propertyType, p, end, prop.cursor->data + offset);
+                    }
+                }
+                else
+                {
+                    if (prop.cursor) offsets[prop.cursorIndex] += stride * values;
+                    for (uint32_t i = 0; i < values; ++i) p = skip_ascii_token(p, end);
+                }
+            }
+        }
+        return p;
+    }
+    
+    // Grows the destinations of a fixed-stride element to hold `count` more
+    // records past their base offsets.
+    inline void size_fixed_cursors(const ElementReadPlan & plan, size_t count)
+    {
+        for (auto & c : plan.cursors)
+        {
+            const size_t neededBytes = c.baseOffset + static_cast<size_t>(c.recordBytes) * count;
+            if (c.cursor->size < neededBytes) resize_cursor(*c.cursor, neededBytes / type_stride(c.cursor->type));
+        }
+    }
+    
+    // Makes room for neededBytes in a list destination. The first list of an
+    // element guesses the total from its own size; later growth doubles.
+    inline void reserve_values(DataCursor & cursor, size_t neededBytes, size_t guessBytes)
+    {
+        if (neededBytes <= cursor.size) return;
+        const size_t bytes = std::max(neededBytes, std::max(cursor.size * 2, guessBytes));
+        resize_cursor(cursor, bytes / type_stride(cursor.type));
+    }
+    
+    // Widest vector store copy_strided may issue
+    const uint32_t kMaxVectorBytes = 32;
+    
+    // Records are interleaved into blocks of about this size before writing
+    const size_t kWriteBlockBytes = 1 << 20;
+    
+    // Below this many records per task a thread costs more than it saves
+    const size_t kMinRecordsPerTask = 1 << 16;
+    
+    // Fixed-stride binary elements are read from streams in blocks of about
+    // this size and decoded like mapped ones
+    const size_t kStreamBlockBytes = 1 << 22;
+    
+    // Decodes `count` records of a fixed-stride binary element starting at
+    // body into the cursor slots after their base offsets.
+    void decode_fixed_element(const ElementReadPlan & plan, const uint8_t * body, const uint8_t * end, size_t count, unsigned int threadCount, bool bigEndian)
+    {
+        parallel_for(count, threadCount, kMinRecordsPerTask, [&](size_t first, size_t last)
+        {
+            decode_fixed_records(plan, body, end, first, last - first);
+            if (bigEndian)
+            {
+                for (auto & c : plan.cursors)
+                {
+                    if (!c.converted) byteswap_cursor(*c.cursor, c.baseOffset + first * c.recordBytes, c.baseOffset + last * c.recordBytes);
+                }
+            }
+        });
+    }
+    
+    // Ascii counterpart of decode_fixed_element; returns the end of the records.
+    const char * decode_fixed_ascii(const ElementReadPlan & plan, const char * p, const char * end, size_t count, unsigned int threadCount)
+    {
+        const size_t cursorCount = plan.cursors.size();
+        const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(resolve_thread_count(threadCount) * 4, count / kMinAsciiRecordsPerTask));
+        const size_t recordsPerChunk = std::max<size_t>(1, (count + chunkCount - 1) / chunkCount);
+        std::vector<const char *> starts;
+        const char * recordsEnd = scan_lines(p, end, count, recordsPerChunk, starts);
+        starts.push_back(recordsEnd);
+        
+        parallel_for(starts.size() - 1, threadCount, 1, [&](size_t first, size_t last)
+        {
+            std::vector<size_t> offsets(cursorCount);
+            for (size_t chunk = first; chunk < last; ++chunk)
+            {
+                const size_t record = chunk * recordsPerChunk;
+                for (size_t c = 0; c < cursorCount; ++c) offsets[c] = plan.cursors[c].baseOffset + record * plan.cursors[c].recordBytes;
+                walk_ascii_records<true>(plan, starts[chunk], starts[chunk + 1], record, std::min(count, record + recordsPerChunk) - record, offsets.data());
+            }
+        });
+        return recordsEnd;
+    }
+    
+    // Passes writes through, counting their bytes.
+    class CountingSink : public PlyWriteSink
+    {
+        
+    public:
+        
+        CountingSink(PlyWriteSink & sink) : bytes(0), sink(sink) {}
+        void write(const uint8_t * data, size_t size) { sink.write(data, size); bytes += size; }
+        
+        uint64_t bytes;
+        
+    private:
+        
+        PlyWriteSink & sink;
+    };
+    
+    // Returns the end of an element without decoding any of it.
+    const uint8_t * skip_element(const ElementReadPlan & plan, const uint8_t * p, const uint8_t * end, bool isBinary, bool bigEndian)
+    {
+        const size_t recordCount = plan.element->size;
+        if (!isBinary)
+        {
+            std::vector<const char *> starts;
+            const char * elementEnd = scan_lines(reinterpret_cast<const char *>(p), reinterpret_cast<const char *>(end), recordCount, std::max<size_t>(recordCount, 1), starts);
+            return reinterpret_cast<const uint8_t *>(elementEnd);
+        }
+        
+        auto check_bounds = [&](size_t bytes)
+        {
+            if (static_cast<size_t>(end - p) < bytes)
+                throw std::runtime_error("unexpected end of binary ply body");
+        };
+        if (plan.fixedStride)
+        {
+            check_bounds(static_cast<size_t>(plan.recordStride) * recordCount);
+            return p + static_cast<size_t>(plan.recordStride) * recordCount;
+        }
+        for (size_t record = 0; record < recordCount; ++record)
+        {
+            for (auto & prop : plan.properties)
+            {
+                const PlyProperty & property = *prop.property;
+                size_t bytes = type_stride(property.propertyType);
+                if (property.isList)
+                {
+                    check_bounds(type_stride(property.listType));
+                    bytes *= read_list_count(property.listType, p, bigEndian);
+                    p += type_stride(property.listType);
+                }
+                check_bounds(bytes);
+                p += bytes;
+            }
+        }
+        return p;
+    }
+    
+} // unnamed namespace
+
+////////////////////////
+// Memory Mapped File //
+////////////////////////
+
+#if defined(_WIN32)
+
+MemoryMappedFile::MemoryMappedFile(const std::string & path)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("failed to open file: " + path);
+    fileHandle = file;
+    
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        throw std::runtime_error("failed to query file size: " + path);
+    }
+    mappedSize = static_cast<size_t>(fileSize.QuadPart);
+    if (mappedSize == 0) return;
+    
+    mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == NULL)
+    {
+        CloseHandle(file);
+        throw std::runtime_error("failed to map file: " + path);
+    }
+    
+    mappedData = static_cast<const uint8_t *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (mappedData == nullptr)
+    {
+        CloseHandle(mappingHandle);
+        CloseHandle(file);
+        throw std::runtime_error("failed to map file: " + path);
+    }
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+    if (mappedData) UnmapViewOfFile(mappedData);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    if (fileHandle) CloseHandle(fileHandle);
+}
+
+void MemoryMappedFile::release(const uint8_t * begin, const uint8_t * end) const
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const uintptr_t page = info.dwPageSize;
+    const uintptr_t first = (reinterpret_cast<uintptr_t>(begin) + page - 1) & ~(page - 1);
+    const uintptr_t last = reinterpret_cast<uintptr_t>(end) & ~(page - 1);
+    // Unlocking pages that are not locked removes them from the working set.
+    if (last > first) VirtualUnlock(reinterpret_cast<void *>(first), last - first);
+}
+
+#else
+
+MemoryMappedFile::MemoryMappedFile(const std::string & path)
+{
+    fileDescriptor = ::open(path.c_str(), O_RDONLY);
+    if (fileDescriptor < 0)
+        throw std::runtime_error("failed to open file: " + path);
+    
+    struct stat st;
+    if (fstat(fileDescriptor, &st) != 0)
+    {
+        ::close(fileDescriptor);
+        throw std::runtime_error("failed to query file size: " + path);
+    }
+    mappedSize = static_cast<size_t>(st.st_size);
+    if (mappedSize == 0) return;
+    
+    void * p = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (p == MAP_FAILED)
+    {
+        ::close(fileDescriptor);
+        throw std::runtime_error("failed to map file: " + path);
+    }
+    madvise(p, mappedSize, MADV_SEQUENTIAL);
+    mappedData = static_cast<const uint8_t *>(p);
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+    if (mappedData) munmap(const_cast<uint8_t *>(mappedData), mappedSize);
+    if (fileDescriptor >= 0) ::close(fileDescriptor);
+}
+
+void MemoryMappedFile::release(const uint8_t * begin, const uint8_t * end) const
+{
+    const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t first = (reinterpret_cast<uintptr_t>(begin) + page - 1) & ~(page - 1);
+    const uintptr_t last = reinterpret_cast<uintptr_t>(end) & ~(page - 1);
+    if (last > first) madvise(reinterpret_cast<void *>(first), last - first, MADV_DONTNEED);
+}
+
+#endif
+
+////////////////
+// Write Sinks //
+////////////////
+
+void OstreamSink::write(const uint8_t * data, size_t size)
+{
+    os.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+    if (!os) throw std::runtime_error("failed to write ply output stream");
+}
+
+void FileDescriptorSink::write(const uint8_t * data, size_t size)
+{
+    while (size > 0)
+    {
+        const unsigned int chunk = static_cast<unsigned int>(std::min<size_t>(size, 1 << 30));
+#if defined(_WIN32)
+        const int written = _write(fd, data, chunk);
+#else
+        const ssize_t written = ::write(fd, data, chunk);
+        if (written < 0 && errno == EINTR) continue;
+#endif
+        if (written <= 0) throw std::runtime_error("failed to write ply output file");
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+FileSink::FileSink(const std::string & path) : file(fopen(path.c_str(), "wb"))
+{
+    if (!file) throw std::runtime_error("failed to create file: " + path);
+    setvbuf(file, nullptr, _IONBF, 0);
+}
+
+FileSink::~FileSink()
+{
+    if (file) fclose(file);
+}
+
+void FileSink::write(const uint8_t * data, size_t size)
+{
+    if (fwrite(data, 1, size, file) != size)
+        throw std::runtime_error("failed to write ply output file");
+}
+
+void FileSink::close()
+{
+    if (file && fclose(file) != 0)
+    {
+        file = nullptr;
+        throw std::runtime_error("failed to close ply output file");
+    }
+    file = nullptr;
+}
+
+void MemorySink::write(const uint8_t * src, size_t size)
+{
+    if (capacity - used < size) throw std::runtime_error("ply output does not fit the memory sink");
+    memcpy(data + used, src, size);
+    used += size;
+}
+
 //////////////////
 // PLY Property //
 //////////////////
@@ -57,6 +1002,8 @@ PlyFile::PlyFile(std::istream & is)
     {
         throw std::runtime_error("file is not ply or encounted junk in header");
     }
+    std::streamoff pos = is.tellg();
+    headerSize = (pos > 0) ? static_cast<size_t>(pos) : 0;
 }
 
 bool PlyFile::parse_header(std::istream& is)
@@ -73,20 +1020,21 @@ bool PlyFile::parse_header(std::istream& is)
             gotMagic = true;
             continue;
         }
-        else if (token == "comment")    read_header_text(line, ls, comments, 7);
+        else if (token == "comment")    read_header_text(line, comments, 8);
         else if (token == "format")     read_header_format(ls);
         else if (token == "element")    read_header_element(ls);
         else if (token == "property")   read_header_property(ls);
-        else if (token == "obj_info")   read_header_text(line, ls, objInfo, 7);
+        else if (token == "obj_info")   read_header_text(line, objInfo, 9);
         else if (token == "end_header") break;
         else return false;
     }
     return true;
 }
 
-void PlyFile::read_header_text(std::string line, std::istream & is, std::vector<std::string> place, int erase)
+void PlyFile::read_header_text(std::string line, std::vector<std::string> & place, int erase)
 {
-    place.push_back((erase > 0) ? line.erase(0, erase) : line);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    place.push_back(line.erase(0, std::min<size_t>(line.size(), std::max(erase, 0))));
 }
 
 void PlyFile::read_header_format(std::istream & is)
@@ -96,7 +1044,10 @@ void PlyFile::read_header_format(std::istream & is)
     if (s == "binary_little_endian")
         isBinary = true;
     else if (s == "binary_big_endian")
-        throw std::runtime_error("big endian formats are not supported!");
+    {
+        isBinary = true;
+        isBigEndian = true;
+    }
 }
 
 void PlyFile::read_header_element(std::istream & is)
@@ -111,168 +1062,529 @@ void PlyFile::read_header_property(std::istream & is)
 
 uint32_t PlyFile::skip_property_binary(const PlyProperty & property, std::istream & is)
 {
-    static std::vector<char> skip(PropertyTable[property.propertyType].stride);
     if (property.isList)
     {
         uint32_t listSize = 0;
-        uint32_t dummyCount = 0;
+        size_t dummyCount = 0;
         read_property_binary(property.listType, &listSize, dummyCount, is);
-        for (uint32_t i = 0; i < listSize; ++i) is.read(skip.data(), PropertyTable[property.propertyType].stride);
+        is.ignore(static_cast<std::streamsize>(listSize) * type_stride(property.propertyType));
         return listSize;
     }
     else
     {
-        is.read(skip.data(), PropertyTable[property.propertyType].stride);
+        is.ignore(type_stride(property.propertyType));
         return 0;
     }
 }
 
-void PlyFile::skip_property_ascii(const PlyProperty & property, std::istream & is)
+void PlyFile::read_property_binary(PlyProperty::Type t, void * dest, size_t & destOffset, std::istream & is)
+{
+    char src[8];
+    const int stride = type_stride(t);
+    is.read(src, stride);
+    if (isBigEndian) std::reverse(src, src + stride);
+    switch (t)
+    {
+        case PlyProperty::Type::INT8:       ply_cast<int8_t>(dest, src);    break;
+        case PlyProperty::Type::UINT8:      ply_cast<uint8_t>(dest, src);   break;
+        case PlyProperty::Type::INT16:      ply_cast<int16_t>(dest, src);   break;
+        case PlyProperty::Type::UINT16:     ply_cast<uint16_t>(dest, src);  break;
+        case PlyProperty::Type::INT32:      ply_cast<int32_t>(dest, src);   break;
+        case PlyProperty::Type::UINT32:     ply_cast<uint32_t>(dest, src);  break;
+        case PlyProperty::Type::FLOAT32:    ply_cast<float>(dest, src);     break;
+        case PlyProperty::Type::FLOAT64:    ply_cast<double>(dest, src);    break;
+        case PlyProperty::Type::INVALID:    throw std::invalid_argument("invalid ply property");
+    }
+    destOffset += stride;
+}
+
+void PlyFile::write_property_ascii(PlyProperty::Type t, std::ostream & os, const uint8_t * src, size_t & srcOffset)
+{
+    switch (t)
+    {
+        case PlyProperty::Type::INT8:       os << static_cast<int32_t>(*reinterpret_cast<const int8_t*>(src));    break;
+        case PlyProperty::Type::UINT8:      os << static_cast<uint32_t>(*reinterpret_cast<const uint8_t*>(src));  break;
+        case PlyProperty::Type::INT16:      os << *reinterpret_cast<const int16_t*>(src);     break;
+        case PlyProperty::Type::UINT16:     os << *reinterpret_cast<const uint16_t*>(src);    break;
+        case PlyProperty::Type::INT32:      os << *reinterpret_cast<const int32_t*>(src);     break;
+        case PlyProperty::Type::UINT32:     os << *reinterpret_cast<const uint32_t*>(src);    break;
+        case PlyProperty::Type::FLOAT32:    os << *reinterpret_cast<const float*>(src);       break;
+        case PlyProperty::Type::FLOAT64:    os << *reinterpret_cast<const double*>(src);      break;
+        case PlyProperty::Type::INVALID:    throw std::invalid_argument("invalid ply property");
+    }
+    os << " ";
+    srcOffset += type_stride(t);
+}
+
+void PlyFile::read(std::istream & is, unsigned int threadCount)
+{
+    if (isBinary)
+    {
+        const std::streamoff begin = is.tellg();
+        read_internal(is, threadCount);
+        const std::streamoff end = is.tellg();
+        collect_read_stats((begin >= 0 && end >= begin) ? static_cast<uint64_t>(end - begin) : 0);
+    }
+    else
+    {
+        std::vector<char> body((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        read_ascii_internal(body.data(), body.data() + body.size(), threadCount);
+        collect_read_stats(body.size());
+    }
+}
+
+void PlyFile::read(const MemoryMappedFile & file, unsigned int threadCount)
+{
+    if (file.size() < headerSize)
+        throw std::runtime_error("mapped file is smaller than its header");
+    
+    const uint8_t * begin = file.data() + headerSize;
+    const uint8_t * end = file.data() + file.size();
+    
+    if (isBinary)
+    {
+        read_binary_internal(begin, end, threadCount);
+    }
+    else
+    {
+        read_ascii_internal(reinterpret_cast<const char *>(begin), reinterpret_cast<const char *>(end), threadCount);
+    }
+    collect_read_stats(static_cast<uint64_t>(end - begin));
+}
+
+void PlyFile::read_chunked(const MemoryMappedFile & file, const std::string & elementKey, size_t chunkRecords, const std::function<void(size_t, size_t)> & callback, unsigned int threadCount)
+{
+    if (file.size() < headerSize)
+        throw std::runtime_error("mapped file is smaller than its header");
+    
+    build_read_plan();
+    chunkRecords = std::max<size_t>(1, chunkRecords);
+    
+    const uint8_t * ptr = file.data() + headerSize;
+    const uint8_t * end = file.data() + file.size();
+    for (auto & plan : readPlan)
+    {
+        if (plan.element->name != elementKey)
+        {
+            ptr = skip_element(plan, ptr, end, isBinary, isBigEndian);
+            continue;
+        }
+        if (!plan.fixedStride)
+            throw std::runtime_error("only elements without lists can be read in chunks: " + elementKey);
+        
+        // Every chunk is decoded to the start of the destinations.
+        ElementReadPlan chunkPlan = plan;
+        for (auto & c : chunkPlan.cursors) c.baseOffset = 0;
+        
+        const size_t recordCount = plan.element->size;
+        for (size_t first = 0; first < recordCount; first += chunkRecords)
+        {
+            const size_t count = std::min(chunkRecords, recordCount - first);
+            for (auto & c : chunkPlan.cursors) resize_cursor(*c.cursor, count * c.recordBytes / type_stride(c.cursor->type));
+            
+            const uint8_t * chunkBegin = ptr;
+            if (isBinary)
+            {
+                const size_t bytes = static_cast<size_t>(plan.recordStride) * count;
+                if (static_cast<size_t>(end - ptr) < bytes)
+                    throw std::runtime_error("unexpected end of binary ply body");
+                decode_fixed_element(chunkPlan, ptr, end, count, threadCount, isBigEndian);
+                ptr += bytes;
+            }
+            else
+            {
+                ptr = reinterpret_cast<const uint8_t *>(decode_fixed_ascii(chunkPlan, reinterpret_cast<const char *>(ptr), reinterpret_cast<const char *>(end), count, threadCount));
+            }
+            for (auto & c : chunkPlan.cursors) c.cursor->offset = count * c.recordBytes;
+            
+            callback(first, count);
+            file.release(chunkBegin, ptr);
+        }
+        
+        // Only the chunked element counts as decoded.
+        for (auto & other : readPlan) other.requested = (&other == &plan);
+        collect_read_stats(static_cast<uint64_t>(ptr - (file.data() + headerSize)));
+        return;
+    }
+}
+
+void PlyFile::read_chunked(std::istream & is, const std::string & elementKey, size_t chunkRecords, const std::function<void(size_t, size_t)> & callback, unsigned int threadCount)
 {
-    std::string skip;
-    if (property.isList)
+    build_read_plan();
+    chunkRecords = std::max<size_t>(1, chunkRecords);
+    
+    uint64_t bodyBytes = 0;
+    std::string line;
+    for (auto & plan : readPlan)
     {
-        int listSize;
-        is >> listSize;
-        for (int i = 0; i < listSize; ++i) is >> skip;
+        const size_t recordCount = plan.element->size;
+        if (plan.element->name != elementKey)
+        {
+            // Ascii records are lines; binary ones are skipped in the stream.
+            if (!isBinary)
+            {
+                for (size_t record = 0; record < recordCount && std::getline(is, line); ++record) bodyBytes += line.size() + 1;
+            }
+            else if (plan.fixedStride)
+            {
+                is.ignore(static_cast<std::streamsize>(plan.recordStride) * recordCount);
+                bodyBytes += static_cast<uint64_t>(plan.recordStride) * recordCount;
+            }
+            else
+            {
+                for (size_t record = 0; record < recordCount; ++record)
+                {
+                    for (auto & p : plan.properties)
+                    {
+                        const uint32_t listSize = skip_property_binary(*p.property, is);
+                        bodyBytes += p.property->isList ? type_stride(p.property->listType) + static_cast<uint64_t>(listSize) * type_stride(p.property->propertyType) : type_stride(p.property->propertyType);
+                    }
+                }
+            }
+            if (!is)
+                throw std::runtime_error("unexpected end of ply body");
+            continue;
+        }
+        if (!plan.fixedStride)
+            throw std::runtime_error("only elements without lists can be read in chunks: " + elementKey);
+        
+        // Every chunk is decoded to the start of the destinations.
+        ElementReadPlan chunkPlan = plan;
+        for (auto & c : chunkPlan.cursors) c.baseOffset = 0;
+        
+        std::vector<char> block;
+        for (size_t first = 0; first < recordCount; first += chunkRecords)
+        {
+            const size_t count = std::min(chunkRecords, recordCount - first);
+            for (auto & c : chunkPlan.cursors) resize_cursor(*c.cursor, count * c.recordBytes / type_stride(c.cursor->type));
+            
+            if (isBinary)
+            {
+                const size_t bytes = static_cast<size_t>(plan.recordStride) * count;
+                block.resize(bytes);
+                is.read(block.data(), static_cast<std::streamsize>(bytes));
+                if (static_cast<size_t>(is.gcount()) != bytes)
+                    throw std::runtime_error("unexpected end of binary ply body");
+                const uint8_t * body = reinterpret_cast<const uint8_t *>(block.data());
+                decode_fixed_element(chunkPlan, body, body + bytes, count, threadCount, isBigEndian);
+            }
+            else
+            {
+                block.clear();
+                for (size_t record = 0; record < count; ++record)
+                {
+                    if (!std::getline(is, line))
+                        throw std::runtime_error("unexpected end of ascii ply body");
+                    block.insert(block.end(), line.begin(), line.end());
+                    block.push_back('\n');
+                }
+                decode_fixed_ascii(chunkPlan, block.data(), block.data() + block.size(), count, threadCount);
+            }
+            bodyBytes += block.size();
+            for (auto & c : chunkPlan.cursors) c.cursor->offset = count * c.recordBytes;
+            
+            callback(first, count);
+        }
+        
+        // Only the chunked element counts as decoded.
+        for (auto & other : readPlan) other.requested = (&other == &plan);
+        collect_read_stats(bodyBytes);
+        return;
     }
-    else is >> skip;
 }
 
-void PlyFile::read_property_binary(PlyProperty::Type t, void * dest, uint32_t & destOffset, std::istream & is)
+void PlyFile::collect_read_stats(uint64_t bodyBytes)
 {
-    static std::vector<char> src(PropertyTable[t].stride);
-    is.read(src.data(), PropertyTable[t].stride);
-    switch (t)
+    readStats = PlyReadStats();
+    readStats.bodyBytes = bodyBytes;
+    for (auto & plan : readPlan)
     {
-        case PlyProperty::Type::INT8:       ply_cast<int8_t>(dest, src.data());    break;
-        case PlyProperty::Type::UINT8:      ply_cast<uint8_t>(dest, src.data());   break;
-        case PlyProperty::Type::INT16:      ply_cast<int16_t>(dest, src.data());   break;
-        case PlyProperty::Type::UINT16:     ply_cast<uint16_t>(dest, src.data());  break;
-        case PlyProperty::Type::INT32:      ply_cast<int32_t>(dest, src.data());   break;
-        case PlyProperty::Type::UINT32:     ply_cast<uint32_t>(dest, src.data());  break;
-        case PlyProperty::Type::FLOAT32:    ply_cast<float>(dest, src.data());     break;
-        case PlyProperty::Type::FLOAT64:    ply_cast<double>(dest, src.data());    break;
-        case PlyProperty::Type::INVALID:    throw std::invalid_argument("invalid ply property");
+        if (plan.requested)
+        {
+            readStats.elementsDecoded++;
+            readStats.recordsDecoded += plan.element->size;
+        }
+        else
+        {
+            readStats.elementsSkipped++;
+            readStats.recordsSkipped += plan.element->size;
+        }
     }
-    destOffset += PropertyTable[t].stride;
-}
-
-void PlyFile::read_property_ascii(PlyProperty::Type t, void * dest, uint32_t & destOffset, std::istream & is)
-{
-    switch (t)
+    
+    // Several properties may share one destination.
+    std::vector<const DataCursor *> seen;
+    for (auto & entry : userDataTable)
     {
-        case PlyProperty::Type::INT8:       *((int8_t *)dest) = ply_read_ascii<int32_t>(is);        break;
-        case PlyProperty::Type::UINT8:      *((uint8_t *)dest) = ply_read_ascii<uint32_t>(is);      break;
-        case PlyProperty::Type::INT16:      ply_cast_ascii<int16_t>(dest, is);                      break;
-        case PlyProperty::Type::UINT16:     ply_cast_ascii<uint16_t>(dest, is);                     break;
-        case PlyProperty::Type::INT32:      ply_cast_ascii<int32_t>(dest, is);                      break;
-        case PlyProperty::Type::UINT32:     ply_cast_ascii<uint32_t>(dest, is);                     break;
-        case PlyProperty::Type::FLOAT32:    ply_cast_ascii<float>(dest, is);                        break;
-        case PlyProperty::Type::FLOAT64:    ply_cast_ascii<double>(dest, is);                       break;
-        case PlyProperty::Type::INVALID:    throw std::invalid_argument("invalid ply property");
+        const DataCursor * cursor = entry.second.get();
+        if (std::find(seen.begin(), seen.end(), cursor) != seen.end()) continue;
+        seen.push_back(cursor);
+        readStats.destinationResizes += cursor->resizes;
+        readStats.destinationBytes += cursor->size;
+        readStats.peakDestinationBytes = std::max<uint64_t>(readStats.peakDestinationBytes, cursor->size);
     }
-    destOffset += PropertyTable[t].stride;
 }
 
-void PlyFile::write_property_ascii(PlyProperty::Type t, std::ostringstream & os, uint8_t * src, uint32_t & srcOffset)
+std::vector<int64_t> PlyFile::get_element_offsets() const
 {
-    switch (t)
+    std::vector<int64_t> offsets(elements.size(), -1);
+    int64_t offset = static_cast<int64_t>(headerSize);
+    for (size_t i = 0; i < elements.size(); ++i)
     {
-        case PlyProperty::Type::INT8:       os << static_cast<int32_t>(*reinterpret_cast<int8_t*>(src));    break;
-        case PlyProperty::Type::UINT8:      os << static_cast<uint32_t>(*reinterpret_cast<uint8_t*>(src));  break;
-        case PlyProperty::Type::INT16:      os << *reinterpret_cast<int16_t*>(src);     break;
-        case PlyProperty::Type::UINT16:     os << *reinterpret_cast<uint16_t*>(src);    break;
-        case PlyProperty::Type::INT32:      os << *reinterpret_cast<int32_t*>(src);     break;
-        case PlyProperty::Type::UINT32:     os << *reinterpret_cast<uint32_t*>(src);    break;
-        case PlyProperty::Type::FLOAT32:    os << *reinterpret_cast<float*>(src);       break;
-        case PlyProperty::Type::FLOAT64:    os << *reinterpret_cast<double*>(src);      break;
-        case PlyProperty::Type::INVALID:    throw std::invalid_argument("invalid ply property");
+        offsets[i] = offset;
+        if (!isBinary) break;
+        
+        int64_t stride = 0;
+        for (const auto & p : elements[i].properties)
+        {
+            if (p.isList) { stride = -1; break; }
+            stride += type_stride(p.propertyType);
+        }
+        if (stride < 0) break;
+        offset += stride * elements[i].size;
     }
-    os << " ";
-    srcOffset += PropertyTable[t].stride;
+    return offsets;
 }
 
-void PlyFile::write_property_binary(PlyProperty::Type t, std::ostringstream & os, uint8_t * src, uint32_t & srcOffset)
+std::vector<int64_t> PlyFile::find_element_offsets(const MemoryMappedFile & file)
 {
-    os.write(reinterpret_cast<const char *>(src), PropertyTable[t].stride);
-    srcOffset += PropertyTable[t].stride;
+    if (file.size() < headerSize)
+        throw std::runtime_error("mapped file is smaller than its header");
+    
+    build_read_plan();
+    std::vector<int64_t> offsets;
+    const uint8_t * ptr = file.data() + headerSize;
+    const uint8_t * end = file.data() + file.size();
+    for (auto & plan : readPlan)
+    {
+        offsets.push_back(static_cast<int64_t>(ptr - file.data()));
+        ptr = skip_element(plan, ptr, end, isBinary, isBigEndian);
+    }
+    return offsets;
 }
 
-void PlyFile::read(std::istream & is)
+void PlyFile::write(std::ostream & os, bool isBinary, bool bigEndian)
 {
-    read_internal(is);
+    OstreamSink sink(os);
+    write(sink, isBinary, bigEndian);
 }
 
-void PlyFile::write(std::ostringstream & os, bool isBinary)
+void PlyFile::write(PlyWriteSink & sink, bool isBinary, bool bigEndian)
 {
-    if (isBinary) write_binary_internal(os);
-    else write_ascii_internal(os);
+    isBigEndian = isBinary && bigEndian;
+    CountingSink counter(sink);
+    if (isBinary) write_binary_internal(counter);
+    else write_ascii_internal(counter);
+    
+    writeStats = PlyWriteStats();
+    writeStats.bytesWritten = counter.bytes;
+    for (auto & e : elements)
+    {
+        writeStats.elementsWritten++;
+        writeStats.recordsWritten += e.size;
+    }
 }
 
-void PlyFile::write_binary_internal(std::ostringstream & os)
+void PlyFile::build_write_plan(std::vector<ElementWritePlan> & plans)
 {
-    isBinary = true;
-    write_header(os);
-    
+    plans.clear();
     for (auto & e : elements)
     {
-        for (int i = 0; i < e.size; ++i)
+        ElementWritePlan plan;
+        plan.element = &e;
+        
+        uint32_t recordOffset = 0;
+        for (auto & p : e.properties)
+        {
+            auto it = userDataTable.find(make_key(e.name, p.name));
+            if (it == userDataTable.end())
+                throw std::runtime_error("no data was added for property: " + p.name);
+            DataCursor * cursor = it->second.get();
+            
+            if (p.isList)
+            {
+                ListCountPlan count = { recordOffset, static_cast<uint32_t>(type_stride(p.listType)), static_cast<uint32_t>(p.listCount) };
+                plan.listCounts.push_back(count);
+                recordOffset += count.bytes;
+            }
+            const uint32_t bytes = type_stride(p.propertyType) * (p.isList ? p.listCount : 1);
+            
+            size_t c = 0;
+            while (c < plan.cursors.size() && plan.cursors[c].cursor != cursor) ++c;
+            if (c == plan.cursors.size())
+            {
+                CursorPlan cp = { cursor, 0, 0, 0, false };
+                plan.cursors.push_back(cp);
+            }
+            CursorPlan & cp = plan.cursors[c];
+            
+            CopyRun * last = plan.runs.empty() ? nullptr : &plan.runs.back();
+            if (last && last->cursorIndex == c && last->dstOffset + last->bytes == recordOffset && last->srcOffset + last->bytes == cp.recordBytes)
+            {
+                last->bytes += bytes;
+            }
+            else
+            {
+                CopyRun run = { cp.recordBytes, recordOffset, bytes, static_cast<uint32_t>(c) };
+                plan.runs.push_back(run);
+                cp.runCount++;
+            }
+            cp.recordBytes += bytes;
+            recordOffset += bytes;
+        }
+        plan.recordStride = recordOffset;
+        
+        if (isBigEndian)
         {
+            auto add_swap = [&](uint32_t offset, uint32_t bytes, uint32_t width)
+            {
+                if (width < 2 || bytes == 0) return;
+                SwapRun * last = plan.swaps.empty() ? nullptr : &plan.swaps.back();
+                if (last && last->width == width && last->offset + last->bytes == offset) last->bytes += bytes;
+                else
+                {
+                    SwapRun run = { offset, bytes, width };
+                    plan.swaps.push_back(run);
+                }
+            };
+            uint32_t offset = 0;
             for (auto & p : e.properties)
             {
-                auto & cursor = userDataTable[make_key(e.name, p.name)];
                 if (p.isList)
                 {
-                    uint8_t listSize[4] = {0, 0, 0, 0};
-                    memcpy(listSize, &p.listCount, sizeof(uint32_t));
-                    uint32_t dummyCount = 0;
-                    write_property_binary(p.listType, os, listSize, dummyCount);
-                    for (int j = 0; j < p.listCount; ++j)
-                    {
-                        write_property_binary(p.propertyType, os, (cursor->data + cursor->offset), cursor->offset);
-                    }
+                    add_swap(offset, type_stride(p.listType), type_stride(p.listType));
+                    offset += type_stride(p.listType);
                 }
-                else
+                const uint32_t bytes = type_stride(p.propertyType) * (p.isList ? p.listCount : 1);
+                add_swap(offset, bytes, type_stride(p.propertyType));
+                offset += bytes;
+            }
+        }
+        
+        for (auto & cp : plan.cursors)
+        {
+            if (cp.cursor->size < static_cast<size_t>(cp.recordBytes) * e.size)
+                throw std::runtime_error("not enough data was added for element: " + e.name);
+        }
+        plans.push_back(plan);
+    }
+}
+
+void PlyFile::write_binary_internal(PlyWriteSink & sink)
+{
+    isBinary = true;
+    write_header(sink);
+    
+    std::vector<ElementWritePlan> plans;
+    build_write_plan(plans);
+    
+    std::vector<uint8_t> block;
+    for (auto & plan : plans)
+    {
+        const size_t recordCount = plan.element->size;
+        if (recordCount == 0 || plan.recordStride == 0) continue;
+        
+        const size_t recordsPerBlock = std::max<size_t>(1, kWriteBlockBytes / plan.recordStride);
+        block.resize(std::min(recordsPerBlock, recordCount) * plan.recordStride);
+        
+        for (size_t first = 0; first < recordCount; first += recordsPerBlock)
+        {
+            const size_t count = std::min(recordsPerBlock, recordCount - first);
+            uint8_t * dst = block.data();
+            uint8_t * blockEnd = dst + count * plan.recordStride;
+            
+            // Runs go in record order; a vector store may only spill into
+            // bytes of the same record that a later run or count overwrites.
+            for (auto & run : plan.runs)
+            {
+                const CursorPlan & c = plan.cursors[run.cursorIndex];
+                const uint8_t * src = c.cursor->data + first * c.recordBytes + run.srcOffset;
+                const uint8_t * srcLimit = c.cursor->data + c.cursor->size;
+                const bool canSpill = plan.runs.size() == 1 || run.dstOffset + kMaxVectorBytes <= plan.recordStride;
+                copy_strided(dst + run.dstOffset, plan.recordStride, src, c.recordBytes, count, run.bytes, srcLimit, canSpill ? blockEnd : dst + run.dstOffset);
+            }
+            for (auto & lc : plan.listCounts)
+            {
+                const uint32_t value = lc.count;
+                for (size_t i = 0; i < count; ++i) memcpy(dst + i * plan.recordStride + lc.offset, &value, lc.bytes);
+            }
+            
+            // Records of a single scalar width swap as one contiguous block.
+            if (plan.swaps.size() == 1 && plan.swaps[0].bytes == plan.recordStride)
+            {
+                byteswap_block(dst, count * plan.recordStride / plan.swaps[0].width, plan.swaps[0].width);
+            }
+            else if (!plan.swaps.empty())
+            {
+                for (size_t i = 0; i < count; ++i)
                 {
-                    write_property_binary(p.propertyType, os, (cursor->data + cursor->offset), cursor->offset);
+                    uint8_t * record = dst + i * plan.recordStride;
+                    for (auto & swap : plan.swaps) byteswap_block(record + swap.offset, swap.bytes / swap.width, swap.width);
                 }
             }
+            sink.write(dst, count * plan.recordStride);
         }
     }
 }
 
-void PlyFile::write_ascii_internal(std::ostringstream & os)
+void PlyFile::write_ascii_internal(PlyWriteSink & sink)
 {
-    write_header(os);
+    isBinary = false;
+    write_header(sink);
     
-    for (auto & e : elements)
+    std::vector<ElementWritePlan> plans;
+    build_write_plan(plans);
+    
+    std::ostringstream os;
+    os.imbue(std::locale::classic());
+    for (auto & plan : plans)
     {
-        for (int i = 0; i < e.size; ++i)
+        std::vector<size_t> offsets(plan.cursors.size(), 0);
+        std::vector<uint32_t> propertyCursors;
+        for (auto & p : plan.element->properties)
         {
-            for (auto & p : e.properties)
+            DataCursor * cursor = userDataTable[make_key(plan.element->name, p.name)].get();
+            uint32_t c = 0;
+            while (plan.cursors[c].cursor != cursor) ++c;
+            propertyCursors.push_back(c);
+        }
+        
+        for (int64_t i = 0; i < plan.element->size; ++i)
+        {
+            for (size_t k = 0; k < plan.element->properties.size(); ++k)
             {
-                auto & cursor = userDataTable[make_key(e.name, p.name)];
+                const PlyProperty & p = plan.element->properties[k];
+                const uint32_t c = propertyCursors[k];
+                const uint8_t * data = plan.cursors[c].cursor->data;
                 if (p.isList)
                 {
                     os << p.listCount << " ";
                     for (int j = 0; j < p.listCount; ++j)
                     {
-                        write_property_ascii(p.propertyType, os, (cursor->data + cursor->offset), cursor->offset);
+                        write_property_ascii(p.propertyType, os, data + offsets[c], offsets[c]);
                     }
                 }
                 else
                 {
-                    write_property_ascii(p.propertyType, os, (cursor->data + cursor->offset), cursor->offset);
+                    write_property_ascii(p.propertyType, os, data + offsets[c], offsets[c]);
                 }
             }
-            os << std::endl;
+            os << '\n';
+            
+            if (os.tellp() >= static_cast<std::streamoff>(kWriteBlockBytes))
+            {
+                const std::string text = os.str();
+                sink.write(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+                os.str(std::string());
+            }
         }
     }
+    const std::string text = os.str();
+    sink.write(reinterpret_cast<const uint8_t *>(text.data()), text.size());
 }
 
-void PlyFile::write_header(std::ostringstream & os)
+void PlyFile::write_header(PlyWriteSink & sink)
 {
+    std::ostringstream os;
     const std::locale & fixLoc = std::locale("C");
     os.imbue(fixLoc);
     
@@ -302,60 +1614,497 @@ void PlyFile::write_header(std::ostringstream & os)
         }
     }
     os << "end_header" << std::endl;
+    
+    const std::string header = os.str();
+    sink.write(reinterpret_cast<const uint8_t *>(header.data()), header.size());
 }
 
-void PlyFile::read_internal(std::istream & is)
+void PlyFile::set_property_scale(const std::string & elementKey, const std::string & propertyKey, double scale, double bias)
 {
-    std::function<void(PlyProperty::Type t, void * dest, uint32_t & destOffset, std::istream & is)> read;
-    std::function<void(const PlyProperty & property, std::istream & is)> skip;
-    if (isBinary)
+    propertyScales[make_key(elementKey, propertyKey)] = std::make_pair(scale, bias);
+}
+
+void PlyFile::normalize_property(const std::string & elementKey, const std::string & propertyKey)
+{
+    int idx = find_element(elementKey, elements);
+    if (idx < 0) return;
+    for (auto & p : elements[idx].properties)
     {
-        read = [&](PlyProperty::Type t, void * dest, uint32_t & destOffset, std::istream & is) { read_property_binary(t, dest, destOffset, is); };
-        skip = [&](const PlyProperty & property, std::istream & is) { skip_property_binary(property, is); };
+        if (p.name == propertyKey) set_property_scale(elementKey, propertyKey, normalizing_scale(p.propertyType));
     }
-    else
+}
+
+void PlyFile::build_read_plan()
+{
+    readPlan.clear();
+    readPlan.reserve(elements.size());
+    
+    for (auto & element : elements)
+    {
+        ElementReadPlan plan;
+        plan.element = &element;
+        plan.requested = std::find(requestedElements.begin(), requestedElements.end(), element.name) != requestedElements.end();
+        plan.fixedStride = true;
+        plan.recordStride = 0;
+        
+        // Resolve destinations first: a cursor receiving any value of another
+        // type, or a scaled one, converts all of its values.
+        for (auto & property : element.properties)
+        {
+            PropertyReadPlan p = { &property, nullptr, 0, { nullptr, isBigEndian, false, 1.0, 0.0 } };
+            if (plan.requested)
+            {
+                auto it = userDataTable.find(make_key(element.name, property.name));
+                if (it != userDataTable.end()) p.cursor = it->second.get();
+            }
+            
+            if (p.cursor)
+            {
+                size_t c = 0;
+                while (c < plan.cursors.size() && plan.cursors[c].cursor != p.cursor) ++c;
+                if (c == plan.cursors.size())
+                {
+                    CursorPlan cp = { p.cursor, p.cursor->offset, 0, 0, false };
+                    plan.cursors.push_back(cp);
+                }
+                p.cursorIndex = static_cast<uint32_t>(c);
+                
+                auto scale = propertyScales.find(make_key(element.name, property.name));
+                if (scale != propertyScales.end())
+                {
+                    p.conversion.scaled = true;
+                    p.conversion.scale = scale->second.first;
+                    p.conversion.bias = scale->second.second;
+                }
+                if (p.conversion.scaled || p.cursor->type != property.propertyType)
+                    plan.cursors[c].converted = true;
+            }
+            plan.properties.push_back(p);
+            if (property.isList) plan.fixedStride = false;
+        }
+        
+        uint32_t srcOffset = 0;
+        for (auto & p : plan.properties)
+        {
+            const PlyProperty & property = *p.property;
+            CursorPlan * cp = p.cursor ? &plan.cursors[p.cursorIndex] : nullptr;
+            if (cp && cp->converted)
+                p.conversion.convert = select_conversion(property.propertyType, p.cursor->type);
+            
+            if (property.isList) continue;
+            
+            const uint32_t stride = type_stride(property.propertyType);
+            if (cp && cp->converted)
+            {
+                const uint32_t dstStride = type_stride(p.cursor->type);
+                ConvertRun * last = plan.conversions.empty() ? nullptr : &plan.conversions.back();
+                if (last && last->cursorIndex == p.cursorIndex && last->conversion.convert == p.conversion.convert &&
+                    last->conversion.scaled == p.conversion.scaled && last->conversion.scale == p.conversion.scale && last->conversion.bias == p.conversion.bias &&
+                    last->srcOffset + last->values * stride == srcOffset && last->dstOffset + last->values * dstStride == cp->recordBytes)
+                {
+                    last->values++;
+                }
+                else
+                {
+                    ConvertRun run = { srcOffset, cp->recordBytes, 1, p.cursorIndex, p.conversion };
+                    plan.conversions.push_back(run);
+                }
+                cp->recordBytes += dstStride;
+            }
+            else if (cp)
+            {
+                // Coalesce with the previous run when both the source and the
+                // destination bytes are adjacent.
+                CopyRun * last = plan.runs.empty() ? nullptr : &plan.runs.back();
+                if (last && last->cursorIndex == p.cursorIndex && last->srcOffset + last->bytes == srcOffset && last->dstOffset + last->bytes == cp->recordBytes)
+                {
+                    last->bytes += stride;
+                }
+                else
+                {
+                    CopyRun run = { srcOffset, cp->recordBytes, stride, p.cursorIndex };
+                    plan.runs.push_back(run);
+                    cp->runCount++;
+                }
+                cp->recordBytes += stride;
+            }
+            srcOffset += stride;
+        }
+        plan.recordStride = srcOffset;
+        readPlan.push_back(plan);
+    }
+}
+
+// Trims list destinations to the values actually read and turns the per
+// record counts of CSR requests into offsets.
+void PlyFile::finish_list_cursors(const ElementReadPlan & plan)
+{
+    for (auto & p : plan.properties)
     {
-        read = [&](PlyProperty::Type t, void * dest, uint32_t & destOffset, std::istream & is) { read_property_ascii(t, dest, destOffset, is); };
-        skip = [&](const PlyProperty & property, std::istream & is) { skip_property_ascii(property, is); };
+        DataCursor * cursor = p.cursor;
+        if (!cursor || !p.property->isList) continue;
+        
+        if (cursor->offset != cursor->size)
+            resize_cursor(*cursor, cursor->offset / type_stride(cursor->type));
+        
+        if (std::vector<uint32_t> * offsets = cursor->listOffsets)
+        {
+            for (size_t i = 1; i < offsets->size(); ++i) (*offsets)[i] += (*offsets)[i - 1];
+        }
     }
+}
+
+// Binary bodies only; ascii bodies go through read_ascii_internal.
+void PlyFile::read_internal(std::istream & is, unsigned int threadCount)
+{
+    // Values are native once read, so conversions only change their type.
+    auto read_value = [&](const PropertyReadPlan & p, DataCursor & cursor)
+    {
+        if (!p.conversion.convert)
+        {
+            read_property_binary(p.property->propertyType, cursor.data + cursor.offset, cursor.offset, is);
+            return;
+        }
+        uint8_t raw[8];
+        size_t rawOffset = 0;
+        read_property_binary(p.property->propertyType, raw, rawOffset, is);
+        ValueConversion native = p.conversion;
+        native.swap = false;
+        native.convert(cursor.data + cursor.offset, 0, raw, 0, 1, 1, native);
+        cursor.offset += type_stride(cursor.type);
+    };
+    
+    build_read_plan();
     
-    for (auto & element : get_elements())
+    for (auto & plan : readPlan)
     {
-        if (std::find(requestedElements.begin(), requestedElements.end(), element.name) != requestedElements.end())
+        const PlyElement & element = *plan.element;
+        if (!plan.requested && plan.fixedStride)
+        {
+            is.ignore(static_cast<std::streamsize>(plan.recordStride) * element.size);
+            continue;
+        }
+        if (plan.fixedStride)
+        {
+            size_fixed_cursors(plan, element.size);
+            
+            // Whole blocks of records are copied out of the stream, so values
+            // do not go through the stream one at a time.
+            ElementReadPlan blockPlan = plan;
+            const size_t recordCount = static_cast<size_t>(element.size);
+            const size_t blockRecords = std::max<size_t>(1, kStreamBlockBytes / std::max<uint32_t>(1, plan.recordStride));
+            std::vector<uint8_t> block;
+            for (size_t first = 0; first < recordCount; first += blockRecords)
+            {
+                const size_t count = std::min(blockRecords, recordCount - first);
+                const size_t bytes = static_cast<size_t>(plan.recordStride) * count;
+                block.resize(bytes);
+                is.read(reinterpret_cast<char *>(block.data()), static_cast<std::streamsize>(bytes));
+                if (static_cast<size_t>(is.gcount()) != bytes)
+                    throw std::runtime_error("unexpected end of binary ply body");
+                for (size_t c = 0; c < plan.cursors.size(); ++c)
+                {
+                    blockPlan.cursors[c].baseOffset = plan.cursors[c].baseOffset + first * plan.cursors[c].recordBytes;
+                }
+                decode_fixed_element(blockPlan, block.data(), block.data() + bytes, count, threadCount, isBigEndian);
+            }
+            for (auto & c : plan.cursors) c.cursor->offset = c.baseOffset + static_cast<size_t>(c.recordBytes) * element.size;
+            continue;
+        }
+        
+        for (int64_t count = 0; count < element.size; ++count)
         {
-            for (int64_t count = 0; count < element.size; ++count)
+            for (auto & p : plan.properties)
             {
-                for (auto & property : element.properties)
+                const PlyProperty & property = *p.property;
+                if (DataCursor * cursor = p.cursor)
                 {
-                    if (auto & cursor = userDataTable[make_key(element.name, property.name)])
+                    if (property.isList)
                     {
-                        if (property.isList)
+                        uint32_t listSize = 0;
+                        size_t dummyCount = 0;
+                        read_property_binary(property.listType, &listSize, dummyCount, is);
+                        const size_t bytes = static_cast<size_t>(listSize) * type_stride(cursor->type);
+                        reserve_values(*cursor, cursor->offset + bytes, bytes * element.size);
+                        if (cursor->listOffsets) (*cursor->listOffsets)[count + 1] = listSize;
+                        for (uint32_t i = 0; i < listSize; ++i)
                         {
-                            uint32_t listSize = 0;
-                            uint32_t dummyCount = 0;
-                            read(property.listType, &listSize, dummyCount, is);
-                            if (cursor->realloc == false)
-                            {
-                                cursor->realloc = true;
-                                resize_vector(property.propertyType, cursor->vector, listSize * element.size, cursor->data);
-                            }
-                            for (uint32_t i = 0; i < listSize; ++i)
-                            {
-                                read(property.propertyType, (cursor->data + cursor->offset), cursor->offset, is);
-                            }
-                        }
-                        else
-                        {
-                            read(property.propertyType, (cursor->data + cursor->offset), cursor->offset, is);
+                            read_value(p, *cursor);
                         }
                     }
                     else
                     {
-                        skip(property, is);
+                        const size_t bytes = type_stride(cursor->type);
+                        reserve_values(*cursor, cursor->offset + bytes, bytes * element.size);
+                        read_value(p, *cursor);
+                    }
+                }
+                else
+                {
+                    skip_property_binary(property, is);
+                }
+            }
+        }
+        finish_list_cursors(plan);
+    }
+}
+
+void PlyFile::read_binary_internal(const uint8_t * begin, const uint8_t * end, unsigned int threadCount)
+{
+    const uint8_t * ptr = begin;
+    
+    auto check_bounds = [&](size_t bytes)
+    {
+        if (static_cast<size_t>(end - ptr) < bytes)
+            throw std::runtime_error("unexpected end of binary ply body");
+    };
+    
+    build_read_plan();
+    
+    for (auto & plan : readPlan)
+    {
+        const PlyElement & element = *plan.element;
+        
+        if (plan.fixedStride)
+        {
+            // Fixed-stride elements are decoded a whole block at a time, or
+            // skipped without touching their bytes when not requested.
+            const size_t bytes = static_cast<size_t>(plan.recordStride) * element.size;
+            check_bounds(bytes);
+            if (plan.requested)
+            {
+                size_fixed_cursors(plan, element.size);
+                decode_fixed_element(plan, ptr, end, element.size, threadCount, isBigEndian);
+                for (auto & c : plan.cursors) c.cursor->offset = c.baseOffset + static_cast<size_t>(c.recordBytes) * element.size;
+            }
+            ptr += bytes;
+            continue;
+        }
+        
+        if (plan.requested && resolve_thread_count(threadCount) > 1 && element.size >= static_cast<int64_t>(2 * kMinRecordsPerTask))
+        {
+            ptr = read_list_element_parallel(plan, ptr, end, threadCount);
+            continue;
+        }
+        
+        for (int64_t count = 0; count < element.size; ++count)
+        {
+            for (auto & p : plan.properties)
+            {
+                const PlyProperty & property = *p.property;
+                DataCursor * cursor = p.cursor;
+                const size_t stride = type_stride(property.propertyType);
+                if (property.isList)
+                {
+                    const size_t countStride = type_stride(property.listType);
+                    check_bounds(countStride);
+                    const uint32_t listSize = read_list_count(property.listType, ptr, isBigEndian);
+                    ptr += countStride;
+                    
+                    const size_t bytes = listSize * stride;
+                    check_bounds(bytes);
+                    if (cursor)
+                    {
+                        const size_t dstBytes = listSize * type_stride(cursor->type);
+                        reserve_values(*cursor, cursor->offset + dstBytes, dstBytes * element.size);
+                        if (cursor->listOffsets) (*cursor->listOffsets)[count + 1] = listSize;
+                        decode_values(p, cursor->data + cursor->offset, ptr, listSize);
+                        cursor->offset += dstBytes;
+                    }
+                    ptr += bytes;
+                }
+                else
+                {
+                    check_bounds(stride);
+                    if (cursor)
+                    {
+                        const size_t dstBytes = type_stride(cursor->type);
+                        reserve_values(*cursor, cursor->offset + dstBytes, dstBytes * element.size);
+                        decode_values(p, cursor->data + cursor->offset, ptr, 1);
+                        cursor->offset += dstBytes;
+                    }
+                    ptr += stride;
+                }
+            }
+        }
+        if (isBigEndian)
+        {
+            for (auto & c : plan.cursors)
+            {
+                if (!c.converted) byteswap_cursor(*c.cursor, c.baseOffset, c.cursor->offset);
+            }
+        }
+        finish_list_cursors(plan);
+    }
+}
+
+const uint8_t * PlyFile::read_list_element_parallel(const ElementReadPlan & plan, const uint8_t * begin, const uint8_t * end, unsigned int threadCount)
+{
+    const size_t recordCount = plan.element->size;
+    const size_t chunkCount = std::min<size_t>(resolve_thread_count(threadCount) * 4, recordCount / kMinRecordsPerTask);
+    const size_t recordsPerChunk = (recordCount + chunkCount - 1) / chunkCount;
+    const size_t cursorCount = plan.cursors.size();
+    
+    // Pass 1: hop over the records reading only the list counts, noting where
+    // each chunk starts in the body and in every destination cursor.
+    std::vector<const uint8_t *> chunkSrc(chunkCount + 1);
+    std::vector<size_t> chunkOffsets((chunkCount + 1) * cursorCount);
+    std::vector<size_t> offsets(cursorCount);
+    for (size_t c = 0; c < cursorCount; ++c) offsets[c] = plan.cursors[c].baseOffset;
+    
+    const uint8_t * ptr = begin;
+    for (size_t record = 0; record < recordCount; ++record)
+    {
+        if (record % recordsPerChunk == 0)
+        {
+            const size_t chunk = record / recordsPerChunk;
+            chunkSrc[chunk] = ptr;
+            std::copy(offsets.begin(), offsets.end(), chunkOffsets.begin() + chunk * cursorCount);
+        }
+        for (auto & p : plan.properties)
+        {
+            const PlyProperty & property = *p.property;
+            size_t bytes = type_stride(property.propertyType);
+            if (property.isList)
+            {
+                const size_t countStride = type_stride(property.listType);
+                if (static_cast<size_t>(end - ptr) < countStride)
+                    throw std::runtime_error("unexpected end of binary ply body");
+                bytes *= read_list_count(property.listType, ptr, isBigEndian);
+                ptr += countStride;
+            }
+            if (static_cast<size_t>(end - ptr) < bytes)
+                throw std::runtime_error("unexpected end of binary ply body");
+            if (p.cursor) offsets[p.cursorIndex] += bytes / type_stride(property.propertyType) * type_stride(p.cursor->type);
+            ptr += bytes;
+        }
+    }
+    
+    // Prefix sums are known now, so every destination can be sized exactly.
+    for (size_t c = 0; c < cursorCount; ++c)
+    {
+        DataCursor * cursor = plan.cursors[c].cursor;
+        resize_cursor(*cursor, offsets[c] / type_stride(cursor->type));
+        cursor->offset = offsets[c];
+    }
+    
+    // Pass 2: decode the chunks concurrently; each writes a disjoint slice.
+    parallel_for(chunkCount, threadCount, 1, [&](size_t firstChunk, size_t lastChunk)
+    {
+        std::vector<size_t> local(cursorCount);
+        for (size_t chunk = firstChunk; chunk < lastChunk; ++chunk)
+        {
+            const uint8_t * src = chunkSrc[chunk];
+            std::copy(chunkOffsets.begin() + chunk * cursorCount, chunkOffsets.begin() + (chunk + 1) * cursorCount, local.begin());
+            const size_t last = std::min(recordCount, (chunk + 1) * recordsPerChunk);
+            for (size_t record = chunk * recordsPerChunk; record < last; ++record)
+            {
+                for (auto & p : plan.properties)
+                {
+                    const PlyProperty & property = *p.property;
+                    uint32_t values = 1;
+                    if (property.isList)
+                    {
+                        values = read_list_count(property.listType, src, isBigEndian);
+                        if (p.cursor && p.cursor->listOffsets) (*p.cursor->listOffsets)[record + 1] = values;
+                        src += type_stride(property.listType);
+                    }
+                    if (p.cursor)
+                    {
+                        decode_values(p, p.cursor->data + local[p.cursorIndex], src, values);
+                        local[p.cursorIndex] += static_cast<size_t>(values) * type_stride(p.cursor->type);
                     }
+                    src += static_cast<size_t>(values) * type_stride(property.propertyType);
+                }
+            }
+            if (isBigEndian)
+            {
+                for (size_t c = 0; c < cursorCount; ++c)
+                {
+                    if (!plan.cursors[c].converted) byteswap_cursor(*plan.cursors[c].cursor, chunkOffsets[chunk * cursorCount + c], local[c]);
                 }
             }
         }
-        else continue;
+    });
+    
+    finish_list_cursors(plan);
+    return ptr;
+}
+
+void PlyFile::read_ascii_internal(const char * begin, const char * end, unsigned int threadCount)
+{
+    build_read_plan();
+    
+    const char * ptr = begin;
+    for (auto & plan : readPlan)
+    {
+        const size_t recordCount = plan.element->size;
+        const size_t cursorCount = plan.cursors.size();
+        
+        // Every record sits on its own line, so line starts are chunk starts.
+        const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(resolve_thread_count(threadCount) * 4, recordCount / kMinAsciiRecordsPerTask));
+        const size_t recordsPerChunk = std::max<size_t>(1, (recordCount + chunkCount - 1) / chunkCount);
+        std::vector<const char *> starts;
+        const char * elementEnd = scan_lines(ptr, end, recordCount, recordsPerChunk, starts);
+        starts.push_back(elementEnd);
+        
+        if (!plan.requested || cursorCount == 0 || recordCount == 0)
+        {
+            ptr = elementEnd;
+            continue;
+        }
+        
+        const size_t chunks = starts.size() - 1;
+        auto chunk_records = [&](size_t chunk) { return std::min(recordCount, (chunk + 1) * recordsPerChunk) - chunk * recordsPerChunk; };
+        
+        // Destination bytes per chunk: known up front for fixed records, counted
+        // in a first parallel pass when lists make them vary.
+        std::vector<size_t> chunkOffsets((chunks + 1) * cursorCount, 0);
+        if (plan.fixedStride)
+        {
+            size_fixed_cursors(plan, recordCount);
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+                for (size_t c = 0; c < cursorCount; ++c)
+                    chunkOffsets[(chunk + 1) * cursorCount + c] = chunk_records(chunk) * plan.cursors[c].recordBytes;
+        }
+        else
+        {
+            parallel_for(chunks, threadCount, 1, [&](size_t first, size_t last)
+            {
+                for (size_t chunk = first; chunk < last; ++chunk)
+                    walk_ascii_records<false>(plan, starts[chunk], starts[chunk + 1], chunk * recordsPerChunk, chunk_records(chunk), &chunkOffsets[(chunk + 1) * cursorCount]);
+            });
+        }
+        
+        for (size_t c = 0; c < cursorCount; ++c)
+        {
+            size_t offset = plan.cursors[c].baseOffset;
+            for (size_t chunk = 0; chunk <= chunks; ++chunk)
+            {
+                offset += chunkOffsets[chunk * cursorCount + c];
+                chunkOffsets[chunk * cursorCount + c] = offset;
+            }
+        }
+        
+        if (!plan.fixedStride)
+        {
+            for (size_t c = 0; c < cursorCount; ++c)
+            {
+                DataCursor * cursor = plan.cursors[c].cursor;
+                resize_cursor(*cursor, chunkOffsets[chunks * cursorCount + c] / type_stride(cursor->type));
+            }
+        }
+        
+        parallel_for(chunks, threadCount, 1, [&](size_t first, size_t last)
+        {
+            for (size_t chunk = first; chunk < last; ++chunk)
+                walk_ascii_records<true>(plan, starts[chunk], starts[chunk + 1], chunk * recordsPerChunk, chunk_records(chunk), &chunkOffsets[chunk * cursorCount]);
+        });
+        
+        for (size_t c = 0; c < cursorCount; ++c)
+            plan.cursors[c].cursor->offset = chunkOffsets[chunks * cursorCount + c];
+        finish_list_cursors(plan);
+        
+        ptr = elementEnd;
     }
-}
\ No newline at end of file
+}
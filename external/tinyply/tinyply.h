@@ -11,24 +11,20 @@
 #include <algorithm>
 #include <string>
 #include <stdint.h>
+#include <cstdio>
 #include <map>
 #include <iostream>
 #include <sstream>
 #include <type_traits>
 #include <memory>
 #include <functional>
+#include <thread>
+#include <exception>
+#include <limits>
 
 namespace tinyply
 {
     
-    struct DataCursor
-    {
-        void * vector;
-        uint8_t * data;
-        uint32_t offset;
-        bool realloc = false;
-    };
-    
     class PlyProperty
     {
         
@@ -62,6 +58,38 @@ namespace tinyply
         
     };
     
+    struct DataCursor
+    {
+        void * vector;
+        uint8_t * data;
+        size_t offset;
+        size_t size = 0;                                        // bytes currently held by vector
+        PlyProperty::Type type = PlyProperty::Type::INVALID;    // element type of vector
+        std::vector<uint32_t> * listOffsets = nullptr;          // set for CSR list requests
+        uint32_t resizes = 0;                                   // times vector was resized
+    };
+    
+    // What the last read did. Cheap to keep: filled once per read from the
+    // read plan and the destinations.
+    struct PlyReadStats
+    {
+        uint64_t bodyBytes = 0;             // body bytes walked
+        uint32_t elementsDecoded = 0;
+        uint32_t elementsSkipped = 0;
+        uint64_t recordsDecoded = 0;
+        uint64_t recordsSkipped = 0;
+        uint32_t destinationResizes = 0;    // allocations of requested vectors
+        uint64_t destinationBytes = 0;      // bytes held by requested vectors
+        uint64_t peakDestinationBytes = 0;  // largest single requested vector
+    };
+    
+    struct PlyWriteStats
+    {
+        uint64_t bytesWritten = 0;
+        uint32_t elementsWritten = 0;
+        uint64_t recordsWritten = 0;
+    };
+    
     inline std::string make_key(const std::string & a, const std::string & b)
     {
         return (a + "-" + b);
@@ -81,10 +109,20 @@ namespace tinyply
         return data;
     }
     
-    template<typename T>
-    void ply_cast_ascii(void * dest, std::istream & is)
+    inline int type_stride(PlyProperty::Type t)
     {
-        *(static_cast<T *>(dest)) = ply_read_ascii<T>(is);
+        switch (t)
+        {
+            case PlyProperty::Type::INT8:
+            case PlyProperty::Type::UINT8:      return 1;
+            case PlyProperty::Type::INT16:
+            case PlyProperty::Type::UINT16:     return 2;
+            case PlyProperty::Type::INT32:
+            case PlyProperty::Type::UINT32:
+            case PlyProperty::Type::FLOAT32:    return 4;
+            case PlyProperty::Type::FLOAT64:    return 8;
+            default:                            return 0;
+        }
     }
     
     struct PropertyInfo { int stride; std::string str; };
@@ -115,14 +153,14 @@ namespace tinyply
     }
     
     template<typename T>
-    inline uint8_t * resize(void * v, int32_t newSize)
+    inline uint8_t * resize(void * v, size_t newSize)
     {
         auto vec = static_cast<std::vector<T> *>(v);
         vec->resize(newSize);
         return reinterpret_cast<uint8_t *>(vec->data());
     }
     
-    inline void resize_vector(const PlyProperty::Type t, void * v, int32_t newSize, uint8_t *& ptr)
+    inline void resize_vector(const PlyProperty::Type t, void * v, size_t newSize, uint8_t *& ptr)
     {
         switch (t)
         {
@@ -138,6 +176,29 @@ namespace tinyply
         }
     }
     
+    inline void resize_cursor(DataCursor & cursor, size_t count)
+    {
+        resize_vector(cursor.type, cursor.vector, count, cursor.data);
+        cursor.size = count * type_stride(cursor.type);
+        cursor.resizes++;
+    }
+    
+    // Scale that maps the full range of an integer type to [0, 1], or to
+    // [-1, 1] for signed types. Real types are left as they are.
+    inline double normalizing_scale(PlyProperty::Type t)
+    {
+        switch (t)
+        {
+            case PlyProperty::Type::INT8:       return 1.0 / std::numeric_limits<int8_t>::max();
+            case PlyProperty::Type::UINT8:      return 1.0 / std::numeric_limits<uint8_t>::max();
+            case PlyProperty::Type::INT16:      return 1.0 / std::numeric_limits<int16_t>::max();
+            case PlyProperty::Type::UINT16:     return 1.0 / std::numeric_limits<uint16_t>::max();
+            case PlyProperty::Type::INT32:      return 1.0 / std::numeric_limits<int32_t>::max();
+            case PlyProperty::Type::UINT32:     return 1.0 / std::numeric_limits<uint32_t>::max();
+            default:                            return 1.0;
+        }
+    }
+    
     template <typename T>
     inline PlyProperty::Type property_type_for_type(std::vector<T> & theType)
     {
@@ -158,9 +219,9 @@ namespace tinyply
     public:
         
         PlyElement(std::istream & istream);
-        PlyElement(const std::string & name, int count) : name(name), size(count) {}
+        PlyElement(const std::string & name, int64_t count) : name(name), size(count) {}
         std::string name;
-        int size;
+        int64_t size;
         std::vector<PlyProperty> properties;
         
     private:
@@ -169,6 +230,215 @@ namespace tinyply
         
     };
     
+    // A contiguous byte range of a fixed-stride record that is copied to or
+    // from the same cursor, i.e. several adjacent properties coalesced. When
+    // reading the source is the record, when writing it is the cursor slot.
+    struct CopyRun
+    {
+        uint32_t srcOffset;
+        uint32_t dstOffset;
+        uint32_t bytes;
+        uint32_t cursorIndex;
+    };
+    
+    struct CursorPlan
+    {
+        DataCursor * cursor;
+        size_t baseOffset;      // cursor offset when the element starts
+        uint32_t recordBytes;   // bytes of the cursor belonging to one record
+        uint32_t runCount;
+        bool converted;         // values pass through a ValueConversion instead of being copied
+    };
+    
+    struct ValueConversion;
+    
+    // Decodes `values` adjacent scalars of each of `records` records from
+    // the file type into the destination type.
+    typedef void (*ConvertFunction)(uint8_t * dst, size_t dstStride, const uint8_t * src, size_t srcStride, size_t records, uint32_t values, const ValueConversion & conversion);
+    
+    // How file values reach a destination of another type, or a scaled one:
+    // dst = src * scale + bias, optionally byte swapping the source first.
+    struct ValueConversion
+    {
+        ConvertFunction convert;    // null when values are copied as they are
+        bool swap;
+        bool scaled;
+        double scale;
+        double bias;
+    };
+    
+    struct PropertyReadPlan
+    {
+        const PlyProperty * property;
+        DataCursor * cursor;    // null when the property is skipped
+        uint32_t cursorIndex;   // index into ElementReadPlan::cursors
+        ValueConversion conversion;
+    };
+    
+    // Adjacent properties of a fixed-stride record converted into the same
+    // cursor with the same conversion.
+    struct ConvertRun
+    {
+        uint32_t srcOffset;
+        uint32_t dstOffset;
+        uint32_t values;
+        uint32_t cursorIndex;
+        ValueConversion conversion;
+    };
+    
+    // Decoding layout of one element, resolved once before the body is read
+    // so the hot loops never look anything up by name.
+    struct ElementReadPlan
+    {
+        PlyElement * element;
+        bool requested;
+        bool fixedStride;
+        uint32_t recordStride;  // only meaningful for fixed-stride elements
+        std::vector<PropertyReadPlan> properties;
+        std::vector<CursorPlan> cursors;
+        std::vector<CopyRun> runs;
+        std::vector<ConvertRun> conversions;
+    };
+    
+    struct ListCountPlan
+    {
+        uint32_t offset;        // offset of the count inside the record
+        uint32_t bytes;
+        uint32_t count;
+    };
+    
+    // Bytes of a record holding scalars of one width, byte swapped together
+    // when writing big endian.
+    struct SwapRun
+    {
+        uint32_t offset;
+        uint32_t bytes;
+        uint32_t width;
+    };
+    
+    // Encoding layout of one element. Written lists always hold listCount
+    // values, so every written record has a fixed stride.
+    struct ElementWritePlan
+    {
+        const PlyElement * element;
+        uint32_t recordStride;
+        std::vector<CursorPlan> cursors;
+        std::vector<CopyRun> runs;          // sorted by their offset in the record
+        std::vector<ListCountPlan> listCounts;
+        std::vector<SwapRun> swaps;         // empty unless writing big endian
+    };
+    
+    // Destination of PlyFile::write. Writes arrive in large blocks.
+    class PlyWriteSink
+    {
+        
+    public:
+        
+        virtual ~PlyWriteSink() {}
+        virtual void write(const uint8_t * data, size_t size) = 0;
+    };
+    
+    class OstreamSink : public PlyWriteSink
+    {
+        
+    public:
+        
+        OstreamSink(std::ostream & os) : os(os) {}
+        void write(const uint8_t * data, size_t size);
+        
+    private:
+        
+        std::ostream & os;
+    };
+    
+    // Writes through an already open file descriptor, which stays open.
+    class FileDescriptorSink : public PlyWriteSink
+    {
+        
+    public:
+        
+        FileDescriptorSink(int fd) : fd(fd) {}
+        void write(const uint8_t * data, size_t size);
+        
+    private:
+        
+        int fd;
+    };
+    
+    // Creates (or truncates) path and writes to it unbuffered.
+    class FileSink : public PlyWriteSink
+    {
+        
+    public:
+        
+        FileSink(const std::string & path);
+        ~FileSink();
+        void write(const uint8_t * data, size_t size);
+        void close();
+        
+    private:
+        
+        FileSink(const FileSink &);
+        FileSink & operator = (const FileSink &);
+        
+        FILE * file;
+    };
+    
+    // Fills caller owned memory, e.g. a mapped output file.
+    class MemorySink : public PlyWriteSink
+    {
+        
+    public:
+        
+        MemorySink(uint8_t * data, size_t capacity) : data(data), capacity(capacity) {}
+        void write(const uint8_t * src, size_t size);
+        size_t size() const { return used; }
+        
+    private:
+        
+        uint8_t * data;
+        size_t capacity;
+        size_t used = 0;
+    };
+    
+    inline unsigned int resolve_thread_count(unsigned int threadCount)
+    {
+        if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+        return (threadCount == 0) ? 1 : threadCount;
+    }
+    
+    // Splits [0, count) into at most threadCount contiguous ranges of at least
+    // minGrain items and calls fn(begin, end) for each range on its own thread.
+    // The first exception thrown by a worker is rethrown on the caller.
+    template<typename F>
+    void parallel_for(size_t count, unsigned int threadCount, size_t minGrain, F fn)
+    {
+        threadCount = resolve_thread_count(threadCount);
+        size_t chunks = std::min<size_t>(threadCount, (count + minGrain - 1) / std::max<size_t>(minGrain, 1));
+        if (chunks <= 1)
+        {
+            if (count) fn(size_t(0), count);
+            return;
+        }
+        
+        std::vector<std::thread> workers;
+        std::vector<std::exception_ptr> errors(chunks);
+        const size_t per = (count + chunks - 1) / chunks;
+        for (size_t c = 0; c < chunks; ++c)
+        {
+            const size_t begin = c * per;
+            const size_t end = std::min(count, begin + per);
+            if (begin >= end) break;
+            workers.emplace_back([&, c, begin, end]()
+            {
+                try { fn(begin, end); }
+                catch (...) { errors[c] = std::current_exception(); }
+            });
+        }
+        for (auto & w : workers) w.join();
+        for (auto & e : errors) if (e) std::rethrow_exception(e);
+    }
+    
     inline int find_element(const std::string key, std::vector<PlyElement> & list)
     {
         for (int i = 0; i < list.size(); ++i)
@@ -176,6 +446,40 @@ namespace tinyply
         return -1;
     }
     
+    // Read-only view of a whole file mapped into the address space. Element
+    // bodies are decoded straight out of the mapping instead of going through
+    // std::istream::read for every scalar.
+    class MemoryMappedFile
+    {
+        
+    public:
+        
+        MemoryMappedFile(const std::string & path);
+        ~MemoryMappedFile();
+        
+        const uint8_t * data() const { return mappedData; }
+        size_t size() const { return mappedSize; }
+        
+        // Drops the whole pages inside [begin, end) from the resident set once
+        // they have been consumed. The data stays readable.
+        void release(const uint8_t * begin, const uint8_t * end) const;
+        
+    private:
+        
+        MemoryMappedFile(const MemoryMappedFile &);
+        MemoryMappedFile & operator = (const MemoryMappedFile &);
+        
+        const uint8_t * mappedData = nullptr;
+        size_t mappedSize = 0;
+        
+#if defined(_WIN32)
+        void * fileHandle = nullptr;
+        void * mappingHandle = nullptr;
+#else
+        int fileDescriptor = -1;
+#endif
+    };
+    
     class PlyFile
     {
         
@@ -184,16 +488,44 @@ namespace tinyply
         PlyFile() {}
         PlyFile(std::istream & is);
         
-        void read(std::istream & is);
-        void write(std::ostringstream & os, bool isBinary);
+        void read(std::istream & is, unsigned int threadCount = 1);
+        void read(const MemoryMappedFile & file, unsigned int threadCount = 1);
+        // Streams one element of a mapped file through its requested
+        // destinations, at most chunkRecords records at a time. When
+        // callback(first, count) runs the destinations hold only that chunk,
+        // and consumed pages of the mapping are released afterwards, so memory
+        // is bounded by the chunk size instead of the file. Other elements are
+        // skipped. The element must not hold lists.
+        void read_chunked(const MemoryMappedFile & file, const std::string & elementKey, size_t chunkRecords, const std::function<void(size_t, size_t)> & callback, unsigned int threadCount = 1);
+        // The same from a stream positioned at the start of the body, e.g. one
+        // that decompresses the file: at most chunkRecords records are read
+        // from it at a time, so memory stays bounded without a mapping.
+        void read_chunked(std::istream & is, const std::string & elementKey, size_t chunkRecords, const std::function<void(size_t, size_t)> & callback, unsigned int threadCount = 1);
+        
+        void write(std::ostream & os, bool isBinary, bool bigEndian = false);
+        void write(PlyWriteSink & sink, bool isBinary, bool bigEndian = false);
         
         std::vector<PlyElement> & get_elements() { return elements; }
         
+        bool is_binary() const { return isBinary; }
+        bool is_big_endian() const { return isBigEndian; }
+        size_t get_header_size() const { return headerSize; }
+        
+        const PlyReadStats & get_read_stats() const { return readStats; }
+        const PlyWriteStats & get_write_stats() const { return writeStats; }
+        
+        // Byte offset of every element's body from the start of the file, as
+        // far as the header tells: known up to the first element whose records
+        // vary in size (ascii records always do), -1 after it.
+        std::vector<int64_t> get_element_offsets() const;
+        // Every offset, walking the variable sized elements of the body.
+        std::vector<int64_t> find_element_offsets(const MemoryMappedFile & file);
+        
         std::vector<std::string> comments;
         std::vector<std::string> objInfo;
         
         template<typename T>
-        int request_properties_from_element(std::string elementKey, std::vector<std::string> propertyKeys, std::vector<T> & source, int listCount = 1)
+        int64_t request_properties_from_element(std::string elementKey, std::vector<std::string> propertyKeys, std::vector<T> & source, int listCount = 1)
         {
             if (get_elements().size() == 0)
                 return 0;
@@ -213,50 +545,90 @@ namespace tinyply
                     if (e.name != elementKey) continue;
                     for (auto p : e.properties)
                     {
-                        if (p.name == propertyKey)
-                        {
-                            if (PropertyTable[property_type_for_type(source)].stride != PropertyTable[p.propertyType].stride)
-                                throw std::runtime_error("destination vector is wrongly typed to hold this property");
-                            return e.size;
-                            
-                        }
+                        if (p.name == propertyKey) return e.size;
                     }
                 }
-                return 0;
+                return int64_t(0);
             };
             
             // Properties in the userDataTable share the same cursor
             auto cursor = std::make_shared<DataCursor>();
             
-            std::vector<uint32_t> instanceCounts;
+            std::vector<int64_t> instanceCounts;
             
+            // Every key must exist before any is registered, otherwise a partial
+            // match would leave cursors behind that point at no destination.
             for (auto key : propertyKeys)
             {
-                if (int instanceCount = instance_counter(elementKey, key))
-                {
+                if (int64_t instanceCount = instance_counter(elementKey, key))
                     instanceCounts.push_back(instanceCount);
-                    auto result = userDataTable.insert(std::pair<std::string, std::shared_ptr<DataCursor>>(make_key(elementKey, key), cursor));
-                    if (result.second == false)
-                        throw std::runtime_error("property has already been requested: " + key);
-                }
                 else return 0;
             }
             
-            uint32_t totalInstanceSize = [&]() { uint32_t t = 0; for (auto c : instanceCounts) { t += c; } return t; }() * listCount;
-            source.resize(totalInstanceSize); // this satisfies regular properties; cursor->realloc is for list types
+            for (auto key : propertyKeys)
+            {
+                auto result = userDataTable.insert(std::pair<std::string, std::shared_ptr<DataCursor>>(make_key(elementKey, key), cursor));
+                if (result.second == false)
+                    throw std::runtime_error("property has already been requested: " + key);
+            }
+            
+            int64_t totalInstanceSize = [&]() { int64_t t = 0; for (auto c : instanceCounts) { t += c; } return t; }() * listCount;
+            source.clear(); // destinations are sized when the body is read
             cursor->offset = 0;
             cursor->vector = &source;
             cursor->data = reinterpret_cast<uint8_t *>(source.data());
+            cursor->size = 0;
+            cursor->type = property_type_for_type(source);
             
             if (listCount > 1)
             {
-                cursor->realloc = true;
-                return (totalInstanceSize / static_cast<int>(propertyKeys.size())) / listCount;
+                return (totalInstanceSize / static_cast<int64_t>(propertyKeys.size())) / listCount;
             }
             
-            return totalInstanceSize / static_cast<int>(propertyKeys.size());
+            return totalInstanceSize / static_cast<int64_t>(propertyKeys.size());
         }
         
+        // Requests a variable-length list property in CSR form: the values of
+        // record i end up in values[offsets[i]] .. values[offsets[i + 1] - 1].
+        // Returns the number of records.
+        template<typename T>
+        int request_list_property_from_element(std::string elementKey, std::string propertyKey, std::vector<uint32_t> & offsets, std::vector<T> & values)
+        {
+            int idx = find_element(elementKey, get_elements());
+            if (idx < 0) return 0;
+            
+            const PlyElement & e = get_elements()[idx];
+            auto p = std::find_if(e.properties.begin(), e.properties.end(), [&](const PlyProperty & prop) { return prop.name == propertyKey; });
+            if (p == e.properties.end()) return 0;
+            if (!p->isList)
+                throw std::runtime_error("property is not a list: " + propertyKey);
+            auto cursor = std::make_shared<DataCursor>();
+            auto result = userDataTable.insert(std::pair<std::string, std::shared_ptr<DataCursor>>(make_key(elementKey, propertyKey), cursor));
+            if (result.second == false)
+                throw std::runtime_error("property has already been requested: " + propertyKey);
+            
+            if (std::find(requestedElements.begin(), requestedElements.end(), elementKey) == requestedElements.end())
+                requestedElements.push_back(elementKey);
+            
+            values.clear();
+            offsets.assign(e.size + 1, 0);
+            cursor->offset = 0;
+            cursor->vector = &values;
+            cursor->data = reinterpret_cast<uint8_t *>(values.data());
+            cursor->type = property_type_for_type(values);
+            cursor->listOffsets = &offsets;
+            return static_cast<int>(e.size);
+        }
+        
+        // Maps the decoded values of a property to value * scale + bias, e.g.
+        // to dequantize positions. Applies to properties requested with any
+        // destination type.
+        void set_property_scale(const std::string & elementKey, const std::string & propertyKey, double scale, double bias = 0.0);
+        
+        // Maps the full range of an integer property to [0, 1] ([-1, 1] when
+        // signed), e.g. to read uchar colors into a float destination.
+        void normalize_property(const std::string & elementKey, const std::string & propertyKey);
+        
         template<typename T>
         void add_properties_to_element(std::string elementKey, std::vector<std::string> propertyKeys, std::vector<T> & source, int listCount = 1, PlyProperty::Type listType = PlyProperty::Type::INVALID)
         {
@@ -264,6 +636,8 @@ namespace tinyply
             cursor->offset = 0;
             cursor->vector = &source;
             cursor->data = reinterpret_cast<uint8_t *>(source.data());
+            cursor->size = source.size() * sizeof(T);
+            cursor->type = property_type_for_type(source);
             
             auto create_property_on_element = [&](PlyElement & e)
             {
@@ -293,33 +667,42 @@ namespace tinyply
     private:
         
         uint32_t skip_property_binary(const PlyProperty & property, std::istream & is);
-        void skip_property_ascii(const PlyProperty & property, std::istream & is);
         
-        void read_property_binary(PlyProperty::Type t, void * dest, uint32_t & destOffset, std::istream & is);
-        void read_property_ascii(PlyProperty::Type t, void * dest, uint32_t & destOffset, std::istream & is);
-        void write_property_ascii(PlyProperty::Type t, std::ostringstream & os, uint8_t * src, uint32_t & srcOffset);
-        void write_property_binary(PlyProperty::Type t, std::ostringstream & os, uint8_t * src, uint32_t & srcOffset);
+        void read_property_binary(PlyProperty::Type t, void * dest, size_t & destOffset, std::istream & is);
+        void write_property_ascii(PlyProperty::Type t, std::ostream & os, const uint8_t * src, size_t & srcOffset);
         
         bool parse_header(std::istream & is);
-        void write_header(std::ostringstream & os);
+        void write_header(PlyWriteSink & sink);
         
         void read_header_format(std::istream & is);
         void read_header_element(std::istream & is);
         void read_header_property(std::istream & is);
-        void read_header_text(std::string line, std::istream & is, std::vector<std::string> place, int erase = 0);
+        void read_header_text(std::string line, std::vector<std::string> & place, int erase = 0);
         
-        void read_internal(std::istream & is);
+        void build_read_plan();
+        void collect_read_stats(uint64_t bodyBytes);
+        void finish_list_cursors(const ElementReadPlan & plan);
+        void read_internal(std::istream & is, unsigned int threadCount);
+        void read_binary_internal(const uint8_t * begin, const uint8_t * end, unsigned int threadCount);
+        void read_ascii_internal(const char * begin, const char * end, unsigned int threadCount);
+        const uint8_t * read_list_element_parallel(const ElementReadPlan & plan, const uint8_t * begin, const uint8_t * end, unsigned int threadCount);
         
-        void write_ascii_internal(std::ostringstream & os);
-        void write_binary_internal(std::ostringstream & os);
+        void build_write_plan(std::vector<ElementWritePlan> & plans);
+        void write_ascii_internal(PlyWriteSink & sink);
+        void write_binary_internal(PlyWriteSink & sink);
         
         bool isBinary = false;
         bool isBigEndian = false;
+        size_t headerSize = 0;
+        PlyReadStats readStats;
+        PlyWriteStats writeStats;
         
         std::map<std::string, std::shared_ptr<DataCursor>> userDataTable;
+        std::map<std::string, std::pair<double, double>> propertyScales;
         
         std::vector<PlyElement> elements;
         std::vector<std::string> requestedElements;
+        std::vector<ElementReadPlan> readPlan;
     };
     
 } // tinyply
@@ -0,0 +1,663 @@
+#include "compressed_stream.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+#if defined(PLY_TRANSLATOR_WITH_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(PLY_TRANSLATOR_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace
+{
+	// Four buffers of 4 MB: enough for the producer to stay a few blocks
+	// ahead of the decoder without holding much of the file.
+	const size_t kRingBuffers     = 4;
+	const size_t kRingBufferBytes = 1 << 22;
+
+	// Compressed bytes read from, or written to, the file at a time.
+	const size_t kFileChunkBytes = 1 << 20;
+
+	bool ends_with(const std::string& text, const char* suffix)
+	{
+		const size_t length = strlen(suffix);
+		if(text.size() < length) return false;
+		for(size_t i=0; i<length; ++i)
+		{
+			const char c = text[text.size() - length + i];
+			if(((c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c) != suffix[i]) return false;
+		}
+		return true;
+	}
+
+	FILE* open_file(const std::string& path, const char* mode)
+	{
+		FILE* file = fopen(path.c_str(), mode);
+		if(!file)
+		{
+			throw std::runtime_error("failed to open file: " + path);
+		}
+		return file;
+	}
+
+	void require_support(Compression compression)
+	{
+		if(!compression_supported(compression))
+		{
+			throw std::runtime_error(std::string("this build cannot handle ") + compression_name(compression) + " compressed ply files");
+		}
+	}
+
+	// Decompresses the whole file through fill(data, size), which returns
+	// false once the consumer went away.
+	template<typename Fill>
+	void decompress_file(FILE* file, Compression compression, std::atomic<uint64_t>& compressedBytes, Fill fill)
+	{
+		std::vector<uint8_t> input(kFileChunkBytes);
+		std::vector<uint8_t> output(kFileChunkBytes);
+
+		if(compression == kGzip)
+		{
+#if defined(PLY_TRANSLATOR_WITH_ZLIB)
+			z_stream stream;
+			memset(&stream, 0, sizeof(stream));
+			// 32 lets zlib detect the gzip wrapper.
+			if(inflateInit2(&stream, 15 + 32) != Z_OK)
+			{
+				throw std::runtime_error("failed to start gzip decompression");
+			}
+			try
+			{
+				bool ended = false;
+				bool outputFull = false;	// inflate may hold more output
+				for(;;)
+				{
+					if(stream.avail_in == 0 && !outputFull)
+					{
+						const size_t read = fread(input.data(), 1, input.size(), file);
+						if(read == 0)
+						{
+							if(ferror(file)) throw std::runtime_error("failed to read compressed ply file");
+							if(!ended) throw std::runtime_error("unexpected end of gzip stream");
+							break;
+						}
+						compressedBytes += read;
+						stream.next_in  = input.data();
+						stream.avail_in = static_cast<uInt>(read);
+					}
+					if(ended)
+					{
+						// Concatenated gzip members decode as one stream. Only
+						// reset once input of the next member is at hand.
+						inflateReset(&stream);
+						ended = false;
+					}
+					stream.next_out  = output.data();
+					stream.avail_out = static_cast<uInt>(output.size());
+					const int result = inflate(&stream, Z_NO_FLUSH);
+					if(result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+					{
+						throw std::runtime_error(std::string("corrupt gzip stream: ") + (stream.msg ? stream.msg : "unknown error"));
+					}
+					if(!fill(output.data(), output.size() - stream.avail_out)) break;
+					ended = (result == Z_STREAM_END);
+					outputFull = !ended && stream.avail_out == 0;
+				}
+			}
+			catch(...)
+			{
+				inflateEnd(&stream);
+				throw;
+			}
+			inflateEnd(&stream);
+#endif
+		}
+		else if(compression == kZstd)
+		{
+#if defined(PLY_TRANSLATOR_WITH_ZSTD)
+			ZSTD_DCtx* context = ZSTD_createDCtx();
+			if(!context)
+			{
+				throw std::runtime_error("failed to start zstd decompression");
+			}
+			try
+			{
+				size_t pending = 0;	// non zero while a frame is unfinished
+				bool outputFull = false;
+				ZSTD_inBuffer in = { input.data(), 0, 0 };
+				for(;;)
+				{
+					if(in.pos == in.size && !outputFull)
+					{
+						const size_t read = fread(input.data(), 1, input.size(), file);
+						if(read == 0)
+						{
+							if(ferror(file)) throw std::runtime_error("failed to read compressed ply file");
+							if(pending != 0) throw std::runtime_error("unexpected end of zstd stream");
+							break;
+						}
+						compressedBytes += read;
+						in.size = read;
+						in.pos  = 0;
+					}
+					ZSTD_outBuffer out = { output.data(), output.size(), 0 };
+					pending = ZSTD_decompressStream(context, &out, &in);
+					if(ZSTD_isError(pending))
+					{
+						throw std::runtime_error(std::string("corrupt zstd stream: ") + ZSTD_getErrorName(pending));
+					}
+					if(!fill(output.data(), out.pos)) break;
+					outputFull = (out.pos == out.size);
+				}
+			}
+			catch(...)
+			{
+				ZSTD_freeDCtx(context);
+				throw;
+			}
+			ZSTD_freeDCtx(context);
+#endif
+		}
+	}
+}
+
+Compression compression_from_magic(const void* bytes, size_t size)
+{
+	const uint8_t* b = static_cast<const uint8_t*>(bytes);
+	if(size >= 2 && b[0] == 0x1f && b[1] == 0x8b)
+	{
+		return kGzip;
+	}
+	if(size >= 4 && b[0] == 0x28 && b[1] == 0xb5 && b[2] == 0x2f && b[3] == 0xfd)
+	{
+		return kZstd;
+	}
+	return kUncompressed;
+}
+
+Compression compression_from_extension(const std::string& path)
+{
+	if(ends_with(path, ".gz"))  return kGzip;
+	if(ends_with(path, ".zst")) return kZstd;
+	return kUncompressed;
+}
+
+bool is_compressed_ply_name(const std::string& path, Compression compression)
+{
+	switch(compression)
+	{
+	case kGzip: return ends_with(path, ".ply.gz");
+	case kZstd: return ends_with(path, ".ply.zst");
+	default:    return false;
+	}
+}
+
+Compression compression_of_file(const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if(!file)
+	{
+		return kUncompressed;
+	}
+	uint8_t magic[4];
+	const size_t read = fread(magic, 1, sizeof(magic), file);
+	fclose(file);
+	return compression_from_magic(magic, read);
+}
+
+bool compression_from_name(const std::string& name, Compression* compression)
+{
+	if(name == "none")
+	{
+		*compression = kUncompressed;
+	}
+	else if(name == "gzip")
+	{
+		*compression = kGzip;
+	}
+	else if(name == "zstd")
+	{
+		*compression = kZstd;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+bool compression_supported(Compression compression)
+{
+	switch(compression)
+	{
+	case kUncompressed:
+		return true;
+	case kGzip:
+#if defined(PLY_TRANSLATOR_WITH_ZLIB)
+		return true;
+#else
+		return false;
+#endif
+	case kZstd:
+#if defined(PLY_TRANSLATOR_WITH_ZSTD)
+		return true;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+const char* compression_name(Compression compression)
+{
+	switch(compression)
+	{
+	case kGzip: return "gzip";
+	case kZstd: return "zstd";
+	default:    return "none";
+	}
+}
+
+///////////////////////
+// BufferRing        //
+///////////////////////
+
+BufferRing::BufferRing(size_t count, size_t bytes)
+	: buffers(count)
+	, bufferBytes(bytes)
+	, finished(false)
+	, aborted(false)
+{
+	for(size_t i=0; i<buffers.size(); ++i)
+	{
+		buffers[i].reserve(bytes);
+		freeBuffers.push_back(&buffers[i]);
+	}
+}
+
+BufferRing::Buffer* BufferRing::take_free()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this]() { return aborted || !freeBuffers.empty(); });
+	if(aborted)
+	{
+		return nullptr;
+	}
+	Buffer* buffer = freeBuffers.front();
+	freeBuffers.pop_front();
+	buffer->clear();
+	return buffer;
+}
+
+void BufferRing::put_filled(Buffer* buffer)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		filledBuffers.push_back(buffer);
+	}
+	changed.notify_all();
+}
+
+BufferRing::Buffer* BufferRing::take_filled()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this]() { return aborted || finished || !filledBuffers.empty(); });
+	if(aborted || filledBuffers.empty())
+	{
+		return nullptr;
+	}
+	Buffer* buffer = filledBuffers.front();
+	filledBuffers.pop_front();
+	return buffer;
+}
+
+void BufferRing::put_free(Buffer* buffer)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		freeBuffers.push_back(buffer);
+	}
+	changed.notify_all();
+}
+
+void BufferRing::finish()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished = true;
+	}
+	changed.notify_all();
+}
+
+void BufferRing::abort()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		aborted = true;
+	}
+	changed.notify_all();
+}
+
+///////////////////////////
+// DecompressingStream   //
+///////////////////////////
+
+DecompressingStream::DecompressingStream(const std::string& path, Compression compression)
+	: std::istream(nullptr)
+	, buffer(path, compression)
+{
+	rdbuf(&buffer);
+	// Lets errors of the producer reach the caller instead of only setting
+	// badbit.
+	exceptions(std::ios::badbit);
+}
+
+DecompressingStream::~DecompressingStream()
+{
+}
+
+uint64_t DecompressingStream::compressed_bytes() const
+{
+	return buffer.compressed_bytes();
+}
+
+DecompressingStream::Buffer::Buffer(const std::string& path, Compression compression)
+	: file(nullptr)
+	, compression(compression)
+	, ring(kRingBuffers, kRingBufferBytes)
+	, current(nullptr)
+	, consumedBytes(0)
+	, compressedBytes(0)
+{
+	require_support(compression);
+	file = open_file(path, "rb");
+	setvbuf(file, nullptr, _IONBF, 0);
+	producer = std::thread(&Buffer::produce, this);
+}
+
+DecompressingStream::Buffer::~Buffer()
+{
+	ring.abort();
+	if(producer.joinable())
+	{
+		producer.join();
+	}
+	if(file)
+	{
+		fclose(file);
+	}
+}
+
+void DecompressingStream::Buffer::produce()
+{
+	BufferRing::Buffer* filling = nullptr;
+	try
+	{
+		decompress_file(file, compression, compressedBytes, [&](const uint8_t* data, size_t size)
+		{
+			while(size > 0)
+			{
+				if(!filling && !(filling = ring.take_free()))
+				{
+					return false;
+				}
+				const size_t count = std::min(size, ring.buffer_bytes() - filling->size());
+				filling->insert(filling->end(), data, data + count);
+				data += count;
+				size -= count;
+				if(filling->size() == ring.buffer_bytes())
+				{
+					ring.put_filled(filling);
+					filling = nullptr;
+				}
+			}
+			return true;
+		});
+	}
+	catch(const std::exception& e)
+	{
+		// Published by the ring's lock in finish().
+		error = e.what();
+		filling = nullptr;
+	}
+	if(filling && !filling->empty())
+	{
+		ring.put_filled(filling);
+	}
+	ring.finish();
+}
+
+DecompressingStream::Buffer::int_type DecompressingStream::Buffer::underflow()
+{
+	if(gptr() < egptr())
+	{
+		return traits_type::to_int_type(*gptr());
+	}
+	if(current)
+	{
+		consumedBytes += current->size();
+		ring.put_free(current);
+		current = nullptr;
+	}
+	current = ring.take_filled();
+	if(!current)
+	{
+		setg(nullptr, nullptr, nullptr);
+		if(!error.empty())
+		{
+			throw std::runtime_error(error);
+		}
+		return traits_type::eof();
+	}
+	char* begin = reinterpret_cast<char*>(current->data());
+	setg(begin, begin, begin + current->size());
+	return traits_type::to_int_type(*gptr());
+}
+
+DecompressingStream::Buffer::pos_type DecompressingStream::Buffer::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+{
+	// Only tellg is supported: the stream cannot go back.
+	if(offset != 0 || direction != std::ios_base::cur || !(mode & std::ios_base::in))
+	{
+		return pos_type(off_type(-1));
+	}
+	return pos_type(static_cast<off_type>(consumedBytes + (gptr() - eback())));
+}
+
+///////////////////////
+// CompressingSink   //
+///////////////////////
+
+CompressingSink::CompressingSink(const std::string& path, Compression compression, int level)
+	: file(nullptr)
+	, compression(compression)
+	, level(level)
+	, ring(kRingBuffers, kRingBufferBytes)
+	, current(nullptr)
+	, compressedBytes(0)
+{
+	require_support(compression);
+	file = open_file(path, "wb");
+	setvbuf(file, nullptr, _IONBF, 0);
+	current = ring.take_free();
+	consumer = std::thread(&CompressingSink::consume, this);
+}
+
+CompressingSink::~CompressingSink()
+{
+	stop();
+	if(file)
+	{
+		fclose(file);
+	}
+}
+
+void CompressingSink::write(const uint8_t* data, size_t size)
+{
+	while(size > 0)
+	{
+		if(!current)
+		{
+			throw std::runtime_error(error.empty() ? "ply output was closed" : error);
+		}
+		const size_t count = std::min(size, ring.buffer_bytes() - current->size());
+		current->insert(current->end(), data, data + count);
+		data += count;
+		size -= count;
+		if(current->size() == ring.buffer_bytes())
+		{
+			ring.put_filled(current);
+			// Null once the consumer failed; the next pass throws its error.
+			current = ring.take_free();
+		}
+	}
+}
+
+void CompressingSink::close()
+{
+	if(current && !current->empty())
+	{
+		ring.put_filled(current);
+	}
+	current = nullptr;
+	ring.finish();
+	if(consumer.joinable())
+	{
+		consumer.join();
+	}
+	const bool closed = !file || fclose(file) == 0;
+	file = nullptr;
+	if(!error.empty())
+	{
+		throw std::runtime_error(error);
+	}
+	if(!closed)
+	{
+		throw std::runtime_error("failed to close compressed ply output file");
+	}
+}
+
+void CompressingSink::stop()
+{
+	ring.abort();
+	if(consumer.joinable())
+	{
+		consumer.join();
+	}
+}
+
+void CompressingSink::consume()
+{
+	std::vector<uint8_t> output(kFileChunkBytes);
+	auto flush = [&](size_t size)
+	{
+		if(size > 0 && fwrite(output.data(), 1, size, file) != size)
+		{
+			throw std::runtime_error("failed to write compressed ply output file");
+		}
+		compressedBytes += size;
+	};
+
+	try
+	{
+		if(compression == kGzip)
+		{
+#if defined(PLY_TRANSLATOR_WITH_ZLIB)
+			z_stream stream;
+			memset(&stream, 0, sizeof(stream));
+			// 16 asks zlib for the gzip wrapper.
+			if(deflateInit2(&stream, level < 0 ? Z_DEFAULT_COMPRESSION : std::min(level, 9), Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			{
+				throw std::runtime_error("failed to start gzip compression");
+			}
+			try
+			{
+				for(;;)
+				{
+					BufferRing::Buffer* buffer = ring.take_filled();
+					const int flushMode = buffer ? Z_NO_FLUSH : Z_FINISH;
+					stream.next_in  = buffer ? buffer->data() : nullptr;
+					stream.avail_in = buffer ? static_cast<uInt>(buffer->size()) : 0;
+					int result = Z_OK;
+					do
+					{
+						stream.next_out  = output.data();
+						stream.avail_out = static_cast<uInt>(output.size());
+						result = deflate(&stream, flushMode);
+						if(result == Z_STREAM_ERROR)
+						{
+							throw std::runtime_error("gzip compression failed");
+						}
+						flush(output.size() - stream.avail_out);
+					}
+					while(stream.avail_out == 0 || (flushMode == Z_FINISH && result != Z_STREAM_END));
+					if(!buffer)
+					{
+						break;
+					}
+					ring.put_free(buffer);
+				}
+			}
+			catch(...)
+			{
+				deflateEnd(&stream);
+				throw;
+			}
+			deflateEnd(&stream);
+#endif
+		}
+		else if(compression == kZstd)
+		{
+#if defined(PLY_TRANSLATOR_WITH_ZSTD)
+			ZSTD_CCtx* context = ZSTD_createCCtx();
+			if(!context)
+			{
+				throw std::runtime_error("failed to start zstd compression");
+			}
+			try
+			{
+				ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+				for(;;)
+				{
+					BufferRing::Buffer* buffer = ring.take_filled();
+					const ZSTD_EndDirective mode = buffer ? ZSTD_e_continue : ZSTD_e_end;
+					ZSTD_inBuffer in = { buffer ? buffer->data() : nullptr, buffer ? buffer->size() : 0, 0 };
+					size_t remaining = 0;
+					do
+					{
+						ZSTD_outBuffer out = { output.data(), output.size(), 0 };
+						remaining = ZSTD_compressStream2(context, &out, &in, mode);
+						if(ZSTD_isError(remaining))
+						{
+							throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(remaining));
+						}
+						flush(out.pos);
+					}
+					while(mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+					if(!buffer)
+					{
+						break;
+					}
+					ring.put_free(buffer);
+				}
+			}
+			catch(...)
+			{
+				ZSTD_freeCCtx(context);
+				throw;
+			}
+			ZSTD_freeCCtx(context);
+#endif
+		}
+	}
+	catch(const std::exception& e)
+	{
+		// Published by the ring's lock in abort(); the writer sees a null
+		// buffer and throws it.
+		error = e.what();
+		ring.abort();
+	}
+}
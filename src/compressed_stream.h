@@ -0,0 +1,170 @@
+#pragma once
+
+#include "../external/tinyply/tinyply.h"
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <istream>
+#include <atomic>
+#include <streambuf>
+#include <cstdio>
+#include <cstdint>
+
+// Codecs of compressed ply files. gzip needs PLY_TRANSLATOR_WITH_ZLIB and
+// zstd PLY_TRANSLATOR_WITH_ZSTD at build time; without them such files are
+// still recognised but fail to open with a message saying so.
+enum Compression
+{
+	kUncompressed,
+	kGzip,
+	kZstd
+};
+
+// Codec whose magic number starts bytes.
+Compression compression_from_magic(const void* bytes, size_t size);
+
+// Codec named by the extension of path: .gz or .zst.
+Compression compression_from_extension(const std::string& path);
+
+// True when path ends with .ply and the extension of compression, e.g.
+// scan.ply.gz for gzip.
+bool is_compressed_ply_name(const std::string& path, Compression compression);
+
+// Codec of an existing file, from its first bytes.
+Compression compression_of_file(const std::string& path);
+
+// Codec named by "gzip", "zstd" or "none"; false for anything else.
+bool compression_from_name(const std::string& name, Compression* compression);
+
+bool compression_supported(Compression compression);
+const char* compression_name(Compression compression);
+
+// A fixed set of equally sized buffers passed between one producer and one
+// consumer thread. Buffers cycle from free to filled and back, so memory is
+// bounded by the ring whatever the size of the stream.
+class BufferRing
+{
+public:
+
+	typedef std::vector<uint8_t> Buffer;
+
+	BufferRing(size_t count, size_t bytes);
+
+	size_t buffer_bytes() const { return bufferBytes; }
+
+	// Blocks until a buffer is free; null once aborted.
+	Buffer* take_free();
+	void put_filled(Buffer* buffer);
+
+	// Blocks until a buffer is filled; null once finished and drained, or
+	// once aborted.
+	Buffer* take_filled();
+	void put_free(Buffer* buffer);
+
+	// No more buffers will be filled.
+	void finish();
+
+	// Wakes both sides and makes every later take return null.
+	void abort();
+
+private:
+
+	BufferRing(const BufferRing&);
+	BufferRing& operator = (const BufferRing&);
+
+	std::vector<Buffer>     buffers;
+	std::deque<Buffer*>     freeBuffers;
+	std::deque<Buffer*>     filledBuffers;
+	std::mutex              mutex;
+	std::condition_variable changed;
+	size_t                  bufferBytes;
+	bool                    finished;
+	bool                    aborted;
+};
+
+// Input stream over a compressed file. A producer thread decompresses into
+// a ring of large buffers while the stream hands the filled ones to its
+// reader, so decompression and decoding run side by side on two cores.
+// Errors of the producer are thrown from the reading call that reaches
+// them.
+class DecompressingStream : public std::istream
+{
+public:
+
+	DecompressingStream(const std::string& path, Compression compression);
+	~DecompressingStream();
+
+	// Bytes of the compressed file consumed so far.
+	uint64_t compressed_bytes() const;
+
+private:
+
+	class Buffer : public std::streambuf
+	{
+	public:
+
+		Buffer(const std::string& path, Compression compression);
+		~Buffer();
+
+		uint64_t compressed_bytes() const { return compressedBytes.load(); }
+
+	protected:
+
+		int_type underflow();
+		pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode);
+
+	private:
+
+		void produce();
+
+		FILE*                 file;
+		Compression           compression;
+		BufferRing            ring;
+		BufferRing::Buffer*   current;
+		uint64_t              consumedBytes;	// decompressed bytes before current
+		std::atomic<uint64_t> compressedBytes;
+		std::string           error;
+		std::thread           producer;
+	};
+
+	Buffer buffer;
+};
+
+// Ply output compressed on a second thread: tinyply fills ring buffers that
+// a consumer thread compresses and writes to the file.
+class CompressingSink : public tinyply::PlyWriteSink
+{
+public:
+
+	CompressingSink(const std::string& path, Compression compression, int level);
+	~CompressingSink();
+
+	void write(const uint8_t* data, size_t size);
+
+	// Compresses what is left and closes the file; throws on any error.
+	void close();
+
+	// Bytes written to the file so far.
+	uint64_t compressed_bytes() const { return compressedBytes; }
+
+private:
+
+	CompressingSink(const CompressingSink&);
+	CompressingSink& operator = (const CompressingSink&);
+
+	void consume();
+	void stop();
+
+	FILE*               file;
+	Compression         compression;
+	int                 level;
+	BufferRing          ring;
+	BufferRing::Buffer* current;
+	uint64_t            compressedBytes;
+	std::string         error;
+	std::thread         consumer;
+};
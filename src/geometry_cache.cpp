@@ -0,0 +1,375 @@
+#include "geometry_cache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace
+{
+	const char     kCacheMagic[8]  = { 'P', 'L', 'Y', 'C', 'A', 'C', 'H', 'E' };
+	const uint32_t kCacheVersion   = 1;
+	const char* const kCacheExtension = ".plycache";
+
+	const size_t kDefaultCacheMegabytes = 512;
+
+	// FNV-1a, to turn a path into a file name.
+	uint64_t hash_path(const std::string& path)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for(size_t i=0; i<path.size(); ++i)
+		{
+			hash ^= static_cast<unsigned char>(path[i]);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	class CacheFile
+	{
+	public:
+
+		CacheFile(const std::string& path, const char* mode) : file(fopen(path.c_str(), mode)), ok(file != nullptr) {}
+		~CacheFile() { if(file) fclose(file); }
+
+		bool is_ok() const { return ok; }
+
+		bool close()
+		{
+			// Closed even after a failed write, so the file can be removed.
+			const bool closed = file == nullptr || fclose(file) == 0;
+			file = nullptr;
+			ok = ok && closed;
+			return ok;
+		}
+
+		void write(const void* data, size_t size)
+		{
+			ok = ok && (size == 0 || fwrite(data, 1, size, file) == size);
+		}
+
+		void read(void* data, size_t size)
+		{
+			ok = ok && (size == 0 || fread(data, 1, size, file) == size);
+		}
+
+		template<typename T>
+		void write_value(const T& value) { write(&value, sizeof(T)); }
+
+		template<typename T>
+		T read_value() { T value = T(); read(&value, sizeof(T)); return value; }
+
+		template<typename T>
+		void write_array(const std::vector<T>& values)
+		{
+			write_value<uint64_t>(values.size());
+			write(values.data(), values.size() * sizeof(T));
+		}
+
+		// Refuses counts larger than what is left of the file.
+		template<typename T>
+		void read_array(std::vector<T>& values, uint64_t remaining)
+		{
+			const uint64_t count = read_value<uint64_t>();
+			ok = ok && count <= remaining / sizeof(T);
+			if(!ok) return;
+			values.resize(static_cast<size_t>(count));
+			read(values.data(), values.size() * sizeof(T));
+		}
+
+	private:
+
+		FILE* file;
+		bool  ok;
+	};
+
+	// Layout: magic, version, stamp and path of the source, then every array
+	// as a count and raw native endian values.
+	bool write_cache_file(const std::string& cachePath, const std::string& path, int64_t size, int64_t mtime, const MeshArrays& mesh)
+	{
+		// Written aside and renamed, so readers never see half a file.
+		const std::string partial = cachePath + ".partial";
+		CacheFile file(partial, "wb");
+		file.write(kCacheMagic, sizeof(kCacheMagic));
+		file.write_value(kCacheVersion);
+		file.write_value(size);
+		file.write_value(mtime);
+		file.write_value<uint64_t>(path.size());
+		file.write(path.data(), path.size());
+		file.write_value<int32_t>(mesh.colorChannels);
+		file.write_value<int32_t>(mesh.faceColorChannels);
+		file.write_array(mesh.positions);
+		file.write_array(mesh.polygonCounts);
+		file.write_array(mesh.polygonConnects);
+		file.write_array(mesh.normals);
+		file.write_array(mesh.colors);
+		file.write_array(mesh.faceColors);
+		file.write_array(mesh.cornerUVs);
+		file.write_array(mesh.vertexUVs);
+		if(!file.close())
+		{
+			remove(partial.c_str());
+			return false;
+		}
+		remove(cachePath.c_str());
+		return rename(partial.c_str(), cachePath.c_str()) == 0;
+	}
+
+	bool read_cache_file(const std::string& cachePath, const std::string& path, int64_t size, int64_t mtime, MeshArrays& mesh)
+	{
+		int64_t cacheSize  = 0;
+		int64_t cacheMtime = 0;
+		if(!file_stamp(cachePath, &cacheSize, &cacheMtime))
+		{
+			return false;
+		}
+		const uint64_t remaining = static_cast<uint64_t>(cacheSize);
+
+		CacheFile file(cachePath, "rb");
+		char magic[sizeof(kCacheMagic)];
+		file.read(magic, sizeof(magic));
+		if(!file.is_ok() || memcmp(magic, kCacheMagic, sizeof(magic)) != 0 || file.read_value<uint32_t>() != kCacheVersion)
+		{
+			return false;
+		}
+		if(file.read_value<int64_t>() != size || file.read_value<int64_t>() != mtime)
+		{
+			return false;
+		}
+		// Another path may hash to the same name.
+		const uint64_t pathLength = file.read_value<uint64_t>();
+		if(!file.is_ok() || pathLength != path.size())
+		{
+			return false;
+		}
+		std::string cachedPath(path.size(), '\0');
+		file.read(&cachedPath[0], cachedPath.size());
+		if(!file.is_ok() || cachedPath != path)
+		{
+			return false;
+		}
+		mesh.colorChannels     = file.read_value<int32_t>();
+		mesh.faceColorChannels = file.read_value<int32_t>();
+		file.read_array(mesh.positions, remaining);
+		file.read_array(mesh.polygonCounts, remaining);
+		file.read_array(mesh.polygonConnects, remaining);
+		file.read_array(mesh.normals, remaining);
+		file.read_array(mesh.colors, remaining);
+		file.read_array(mesh.faceColors, remaining);
+		file.read_array(mesh.cornerUVs, remaining);
+		file.read_array(mesh.vertexUVs, remaining);
+		return file.is_ok();
+	}
+}
+
+bool file_stamp(const std::string& path, int64_t* size, int64_t* mtime)
+{
+#if defined(_WIN32)
+	struct _stat64 info;
+	if(_stat64(path.c_str(), &info) != 0) return false;
+#else
+	struct stat info;
+	if(stat(path.c_str(), &info) != 0) return false;
+#endif
+	*size  = static_cast<int64_t>(info.st_size);
+	*mtime = static_cast<int64_t>(info.st_mtime);
+	return true;
+}
+
+GeometryCache::GeometryCache(size_t maxBytes)
+	: maxBytes(maxBytes)
+	, usedBytes(0)
+	, hitCount(0)
+	, missCount(0)
+{
+}
+
+void GeometryCache::set_max_bytes(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	maxBytes = bytes;
+	evict_locked();
+}
+
+void GeometryCache::set_directory(const std::string& directory)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	directoryPath = directory;
+}
+
+std::string GeometryCache::directory() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return directoryPath;
+}
+
+std::string GeometryCache::cache_file(const std::string& path) const
+{
+	if(directoryPath.empty())
+	{
+		return std::string();
+	}
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash_path(path)));
+	const char last = directoryPath[directoryPath.size() - 1];
+	return directoryPath + ((last == '/' || last == '\\') ? "" : "/") + name + kCacheExtension;
+}
+
+GeometryCache::Entry GeometryCache::find(const std::string& path, int64_t size, int64_t mtime)
+{
+	std::string cachePath;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::string, std::list<Item>::iterator>::iterator it = index.find(path);
+		if(it != index.end())
+		{
+			if(it->second->size == size && it->second->mtime == mtime)
+			{
+				items.splice(items.begin(), items, it->second);
+				++hitCount;
+				return items.front().mesh;
+			}
+			usedBytes -= it->second->bytes;
+			items.erase(it->second);
+			index.erase(it);
+		}
+		cachePath = cache_file(path);
+	}
+
+	// The file is read without holding the lock.
+	if(!cachePath.empty())
+	{
+		std::shared_ptr<MeshArrays> mesh = std::make_shared<MeshArrays>();
+		if(read_cache_file(cachePath, path, size, mtime, *mesh))
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			Item item = { path, size, mtime, mesh, mesh->byte_size() };
+			insert_locked(item);
+			++hitCount;
+			return mesh;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	++missCount;
+	return Entry();
+}
+
+void GeometryCache::insert(const std::string& path, int64_t size, int64_t mtime, const Entry& mesh)
+{
+	std::string cachePath;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Item item = { path, size, mtime, mesh, mesh->byte_size() };
+		insert_locked(item);
+		cachePath = cache_file(path);
+	}
+	if(!cachePath.empty())
+	{
+		write_cache_file(cachePath, path, size, mtime, *mesh);
+	}
+}
+
+void GeometryCache::insert_locked(const Item& item)
+{
+	if(item.bytes > maxBytes)
+	{
+		return;
+	}
+	std::map<std::string, std::list<Item>::iterator>::iterator it = index.find(item.path);
+	if(it != index.end())
+	{
+		usedBytes -= it->second->bytes;
+		items.erase(it->second);
+		index.erase(it);
+	}
+	items.push_front(item);
+	index[item.path] = items.begin();
+	usedBytes += item.bytes;
+	evict_locked();
+}
+
+void GeometryCache::evict_locked()
+{
+	while(usedBytes > maxBytes && !items.empty())
+	{
+		usedBytes -= items.back().bytes;
+		index.erase(items.back().path);
+		items.pop_back();
+	}
+}
+
+void GeometryCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	items.clear();
+	index.clear();
+	usedBytes = 0;
+}
+
+size_t GeometryCache::bytes() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return usedBytes;
+}
+
+size_t GeometryCache::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return items.size();
+}
+
+int64_t GeometryCache::hits() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return hitCount;
+}
+
+int64_t GeometryCache::misses() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return missCount;
+}
+
+GeometryCache& geometry_cache()
+{
+	static GeometryCache* cache = nullptr;
+	static std::once_flag created;
+	std::call_once(created, []()
+	{
+		const char* megabytes = std::getenv("PLY_TRANSLATOR_CACHE_MB");
+		const size_t budget = megabytes ? static_cast<size_t>(std::max(0, atoi(megabytes))) : kDefaultCacheMegabytes;
+		cache = new GeometryCache(budget << 20);
+		if(const char* directory = std::getenv("PLY_TRANSLATOR_CACHE_DIR"))
+		{
+			cache->set_directory(directory);
+		}
+	});
+	return *cache;
+}
+
+GeometryCache::Entry load_mesh_arrays(const std::string& path, unsigned int threadCount, bool useCache, bool* cacheHit)
+{
+	*cacheHit = false;
+	int64_t size  = 0;
+	int64_t mtime = 0;
+	useCache = useCache && file_stamp(path, &size, &mtime);
+	if(useCache)
+	{
+		if(GeometryCache::Entry cached = geometry_cache().find(path, size, mtime))
+		{
+			*cacheHit = true;
+			return cached;
+		}
+	}
+
+	std::shared_ptr<MeshArrays> mesh = std::make_shared<MeshArrays>();
+	read_mesh_arrays(path, *mesh, threadCount);
+	if(useCache && !mesh->polygonCounts.empty())
+	{
+		geometry_cache().insert(path, size, mtime, mesh);
+	}
+	return mesh;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ply_mesh_data.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+// Size and modification time of a file; false when it cannot be stat'ed.
+bool file_stamp(const std::string& path, int64_t* size, int64_t* mtime);
+
+// Decoded meshes of ply files, keyed by path and valid for as long as the
+// file keeps its size and modification time. The least recently used
+// entries are dropped once the cache holds more than its byte budget. With
+// a directory set, entries are also written there as raw arrays, so they
+// outlive the session and are read back without parsing. All members may
+// be called from several threads at once.
+class GeometryCache
+{
+public:
+
+	typedef std::shared_ptr<const MeshArrays> Entry;
+
+	explicit GeometryCache(size_t maxBytes);
+
+	void set_max_bytes(size_t maxBytes);
+	void set_directory(const std::string& directory);
+	std::string directory() const;
+
+	// The entry of path if it still matches the stamp, from memory or from
+	// the directory; null otherwise.
+	Entry find(const std::string& path, int64_t size, int64_t mtime);
+	void  insert(const std::string& path, int64_t size, int64_t mtime, const Entry& mesh);
+
+	// Drops the entries in memory; files in the directory stay.
+	void clear();
+
+	size_t  bytes() const;
+	size_t  size() const;
+	int64_t hits() const;
+	int64_t misses() const;
+
+private:
+
+	GeometryCache(const GeometryCache&);
+	GeometryCache& operator = (const GeometryCache&);
+
+	struct Item
+	{
+		std::string path;
+		int64_t     size;
+		int64_t     mtime;
+		Entry       mesh;
+		size_t      bytes;
+	};
+
+	std::string cache_file(const std::string& path) const;
+	void insert_locked(const Item& item);
+	void evict_locked();
+
+	mutable std::mutex mutex;
+	std::list<Item>    items;		// most recently used first
+	std::map<std::string, std::list<Item>::iterator> index;
+	std::string directoryPath;
+	size_t  maxBytes;
+	size_t  usedBytes;
+	int64_t hitCount;
+	int64_t missCount;
+};
+
+// Cache shared by the translator and plyImportBatch. Its budget is
+// PLY_TRANSLATOR_CACHE_MB megabytes (512 by default, 0 keeps nothing in
+// memory) and its directory PLY_TRANSLATOR_CACHE_DIR, when set.
+GeometryCache& geometry_cache();
+
+// Decoded mesh of path, from the cache when it matches the file, otherwise
+// parsed and added to the cache. Throws when the file cannot be read.
+GeometryCache::Entry load_mesh_arrays(const std::string& path, unsigned int threadCount, bool useCache, bool* cacheHit);
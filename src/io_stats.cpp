@@ -0,0 +1,130 @@
+#include "io_stats.h"
+
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <locale>
+#include <algorithm>
+
+namespace
+{
+	template<typename T>
+	T& entry(std::vector<std::pair<std::string, T> >& entries, const char* name)
+	{
+		for(size_t i=0; i<entries.size(); ++i)
+		{
+			if(entries[i].first == name) return entries[i].second;
+		}
+		entries.push_back(std::make_pair(std::string(name), T()));
+		return entries.back().second;
+	}
+
+	std::string json_string(const std::string& text)
+	{
+		std::string quoted("\"");
+		for(size_t i=0; i<text.size(); ++i)
+		{
+			const char c = text[i];
+			if(c == '"' || c == '\\') quoted += '\\';
+			quoted += (static_cast<unsigned char>(c) < 0x20) ? ' ' : c;
+		}
+		return quoted + "\"";
+	}
+}
+
+IoStats::Phase::Phase(IoStats& stats, const char* name)
+	: stats(stats)
+	, name(name)
+	, start(clock::now())
+	, running(true)
+{
+}
+
+IoStats::Phase::~Phase()
+{
+	stop();
+}
+
+void IoStats::Phase::stop()
+{
+	if(!running) return;
+	running = false;
+	stats.add_time(name, std::chrono::duration<double, std::milli>(clock::now() - start).count());
+}
+
+IoStats::IoStats()
+	: startTime(0)
+	, succeeded(false)
+	, totalMilliseconds(0.0)
+{
+}
+
+void IoStats::begin(const std::string& operation, const std::string& path)
+{
+	this->operation = operation;
+	this->path = path;
+	startTime = static_cast<int64_t>(std::time(nullptr));
+	succeeded = false;
+	totalMilliseconds = 0.0;
+	phases.clear();
+	counters.clear();
+	start = clock::now();
+}
+
+void IoStats::end(bool succeeded)
+{
+	this->succeeded = succeeded;
+	totalMilliseconds = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+}
+
+void IoStats::add_time(const char* phase, double milliseconds)
+{
+	entry(phases, phase) += milliseconds;
+}
+
+void IoStats::add(const char* counter, int64_t value)
+{
+	entry(counters, counter) += value;
+}
+
+void IoStats::set_max(const char* counter, int64_t value)
+{
+	int64_t& current = entry(counters, counter);
+	current = std::max(current, value);
+}
+
+std::string IoStats::to_json() const
+{
+	std::ostringstream os;
+	os.imbue(std::locale::classic());
+	os << "{\"operation\":" << json_string(operation)
+	   << ",\"path\":" << json_string(path)
+	   << ",\"time\":" << startTime
+	   << ",\"succeeded\":" << (succeeded ? "true" : "false")
+	   << ",\"totalMs\":" << totalMilliseconds
+	   << ",\"phasesMs\":{";
+	for(size_t i=0; i<phases.size(); ++i)
+	{
+		os << (i ? "," : "") << json_string(phases[i].first) << ":" << phases[i].second;
+	}
+	os << "},\"counters\":{";
+	for(size_t i=0; i<counters.size(); ++i)
+	{
+		os << (i ? "," : "") << json_string(counters[i].first) << ":" << counters[i].second;
+	}
+	os << "}}";
+	return os.str();
+}
+
+bool IoStats::append_to_log(const std::string& path) const
+{
+	std::ofstream log(path.c_str(), std::ios::app);
+	log << to_json() << "\n";
+	return static_cast<bool>(log);
+}
+
+IoStats& last_io_stats()
+{
+	static IoStats stats;
+	return stats;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+// Phase timings and counters of one import or export, kept after the
+// operation for the plyStats command and optionally appended to a json
+// lines log. A phase costs two clock reads and a counter an add, so they
+// stay on in release builds. 
+class IoStats
+{
+public:
+
+	typedef std::chrono::steady_clock clock;
+
+	// Times a phase from construction until stop() or destruction. Phases
+	// with the same name add up. 
+	class Phase
+	{
+	public:
+
+		Phase(IoStats& stats, const char* name);
+		~Phase();
+		void stop();
+
+	private:
+
+		IoStats&          stats;
+		const char*       name;
+		clock::time_point start;
+		bool              running;
+	};
+
+	IoStats();
+
+	void begin(const std::string& operation, const std::string& path);
+	void end(bool succeeded);
+
+	void add_time(const char* phase, double milliseconds);
+	void add(const char* counter, int64_t value);
+	void set_max(const char* counter, int64_t value);
+
+	// One json object on a single line. 
+	std::string to_json() const;
+
+	// Appends to_json() and a newline to path. 
+	bool append_to_log(const std::string& path) const;
+
+private:
+
+	std::string operation;
+	std::string path;
+	int64_t     startTime;		// seconds since the epoch
+	bool        succeeded;
+	double      totalMilliseconds;
+	clock::time_point start;
+
+	std::vector<std::pair<std::string, double> >  phases;
+	std::vector<std::pair<std::string, int64_t> > counters;
+};
+
+// Stats of the most recent import or export. Translators run on the main
+// thread, so there is only ever one being filled. 
+IoStats& last_io_stats();
@@ -0,0 +1,183 @@
+#include "mesh_tiler.h"
+#include "../external/tinyply/tinyply.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+	// Below this many faces per task a thread costs more than it saves. 
+	const size_t kMinFacesPerTask = 1 << 16;
+
+	// Deeper than this a box is too small to separate float centroids. 
+	const int kMaxOctreeDepth = 21;
+
+	struct OctreeNode
+	{
+		size_t begin;	// range of the face order
+		size_t end;
+		float  boundsMin[3];
+		float  boundsMax[3];
+		int    depth;
+	};
+
+	inline int octant_of(const float* centroid, const float* mid)
+	{
+		return (centroid[0] >= mid[0] ? 1 : 0) | (centroid[1] >= mid[1] ? 2 : 0) | (centroid[2] >= mid[2] ? 4 : 0);
+	}
+
+	void build_tile(size_t vertexCount, const uint32_t* faceOffsets, const int* connects, const uint32_t* faces, size_t faceCount, MeshTile& tile)
+	{
+		tile.faces.assign(faces, faces + faceCount);
+		std::sort(tile.faces.begin(), tile.faces.end());
+
+		// Sorting (vertex, corner) pairs gives every distinct vertex its local
+		// id without a table sized by the whole mesh. 
+		std::vector<std::pair<uint32_t, uint32_t> > corners;
+		for(size_t i=0; i<tile.faces.size(); ++i)
+		{
+			const uint32_t face = tile.faces[i];
+			for(uint32_t c=faceOffsets[face]; c<faceOffsets[face + 1]; ++c)
+			{
+				const int vertex = connects[c];
+				if(vertex < 0 || static_cast<size_t>(vertex) >= vertexCount)
+				{
+					throw std::runtime_error("face vertex index out of range");
+				}
+				corners.push_back(std::make_pair(static_cast<uint32_t>(vertex), static_cast<uint32_t>(corners.size())));
+			}
+		}
+		std::sort(corners.begin(), corners.end());
+
+		tile.connects.resize(corners.size());
+		tile.vertices.clear();
+		for(size_t i=0; i<corners.size(); ++i)
+		{
+			if(tile.vertices.empty() || tile.vertices.back() != corners[i].first)
+			{
+				tile.vertices.push_back(corners[i].first);
+			}
+			tile.connects[corners[i].second] = static_cast<int>(tile.vertices.size() - 1);
+		}
+
+	}
+}
+
+void build_mesh_tiles(const float* positions, size_t vertexCount, const uint32_t* faceOffsets, size_t faceCount, const int* connects, size_t maxFaces, unsigned int threadCount, std::vector<MeshTile>& tiles)
+{
+	tiles.clear();
+	if(faceCount == 0)
+	{
+		return;
+	}
+	maxFaces = std::max<size_t>(1, maxFaces);
+
+	std::vector<float> centroids(faceCount * 3);
+	tinyply::parallel_for(faceCount, threadCount, kMinFacesPerTask, [&](size_t first, size_t last)
+	{
+		for(size_t f=first; f<last; ++f)
+		{
+			float sum[3] = { 0.0f, 0.0f, 0.0f };
+			const uint32_t begin = faceOffsets[f];
+			const uint32_t end   = faceOffsets[f + 1];
+			for(uint32_t c=begin; c<end; ++c)
+			{
+				const int vertex = connects[c];
+				if(vertex < 0 || static_cast<size_t>(vertex) >= vertexCount) continue;
+				const float* p = positions + static_cast<size_t>(vertex) * 3;
+				sum[0] += p[0];
+				sum[1] += p[1];
+				sum[2] += p[2];
+			}
+			const float scale = (end > begin) ? 1.0f / (end - begin) : 0.0f;
+			centroids[f*3]   = sum[0] * scale;
+			centroids[f*3+1] = sum[1] * scale;
+			centroids[f*3+2] = sum[2] * scale;
+		}
+	});
+
+	OctreeNode root = { 0, faceCount, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, 0 };
+	for(int a=0; a<3; ++a)
+	{
+		root.boundsMin[a] = std::numeric_limits<float>::max();
+		root.boundsMax[a] = -std::numeric_limits<float>::max();
+	}
+	for(size_t f=0; f<faceCount; ++f)
+	{
+		for(int a=0; a<3; ++a)
+		{
+			root.boundsMin[a] = std::min(root.boundsMin[a], centroids[f*3+a]);
+			root.boundsMax[a] = std::max(root.boundsMax[a], centroids[f*3+a]);
+		}
+	}
+
+	// Split depth first; every split is a counting sort of the node's range
+	// into its eight octants. 
+	std::vector<uint32_t> order(faceCount);
+	std::vector<uint32_t> scratch(faceCount);
+	for(size_t f=0; f<faceCount; ++f)
+	{
+		order[f] = static_cast<uint32_t>(f);
+	}
+
+	std::vector<OctreeNode> leaves;
+	std::vector<OctreeNode> pending(1, root);
+	while(!pending.empty())
+	{
+		const OctreeNode node = pending.back();
+		pending.pop_back();
+		if(node.end - node.begin <= maxFaces || node.depth >= kMaxOctreeDepth)
+		{
+			leaves.push_back(node);
+			continue;
+		}
+
+		float mid[3];
+		for(int a=0; a<3; ++a)
+		{
+			mid[a] = 0.5f * (node.boundsMin[a] + node.boundsMax[a]);
+		}
+
+		size_t starts[9] = { 0 };
+		for(size_t i=node.begin; i<node.end; ++i)
+		{
+			starts[octant_of(&centroids[order[i] * 3], mid) + 1]++;
+		}
+		starts[0] = node.begin;
+		for(int o=1; o<9; ++o)
+		{
+			starts[o] += starts[o - 1];
+		}
+		size_t fill[8];
+		std::copy(starts, starts + 8, fill);
+		for(size_t i=node.begin; i<node.end; ++i)
+		{
+			scratch[fill[octant_of(&centroids[order[i] * 3], mid)]++] = order[i];
+		}
+		std::copy(scratch.begin() + node.begin, scratch.begin() + node.end, order.begin() + node.begin);
+
+		for(int o=7; o>=0; --o)
+		{
+			if(starts[o + 1] == starts[o]) continue;
+			OctreeNode child = { starts[o], starts[o + 1], { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, node.depth + 1 };
+			for(int a=0; a<3; ++a)
+			{
+				const bool upper = (o >> a) & 1;
+				child.boundsMin[a] = upper ? mid[a] : node.boundsMin[a];
+				child.boundsMax[a] = upper ? node.boundsMax[a] : mid[a];
+			}
+			pending.push_back(child);
+		}
+	}
+
+	tiles.resize(leaves.size());
+	tinyply::parallel_for(leaves.size(), threadCount, 1, [&](size_t first, size_t last)
+	{
+		for(size_t t=first; t<last; ++t)
+		{
+			build_tile(vertexCount, faceOffsets, connects, order.data() + leaves[t].begin, leaves[t].end - leaves[t].begin, tiles[t]);
+		}
+	});
+}
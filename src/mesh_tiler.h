@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// One spatial tile of a mesh: a subset of its faces with the vertices they
+// use renumbered from zero.
+struct MeshTile
+{
+	std::vector<uint32_t> faces;		// source face ids, ascending
+	std::vector<uint32_t> vertices;		// source vertex id of every local vertex
+	std::vector<int>      connects;		// corners of faces, in local vertex ids
+};
+
+// Bins the faces of a mesh into the leaves of an octree over their
+// centroids, so that no tile holds more than maxFaces faces (unless faces
+// share one centroid). Faces are given as offsets into connects, one more
+// offset than faces. Tiles are built in parallel and come out in depth-first
+// octree order, so neighbouring tiles are neighbours in space.
+void build_mesh_tiles(const float* positions, size_t vertexCount, const uint32_t* faceOffsets, size_t faceCount, const int* connects, size_t maxFaces, unsigned int threadCount, std::vector<MeshTile>& tiles);
@@ -0,0 +1,224 @@
+#include "mesh_weld.h"
+#include "../external/tinyply/tinyply.h"
+
+#include <atomic>
+#include <memory>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+	// Below this many vertices per task a thread costs more than it saves. 
+	const size_t kMinVerticesPerTask = 1 << 16;
+
+	const uint32_t kEmptySlot = 0xFFFFFFFFu;
+
+	// Position cells take two words per axis, normals three and uvs two. 
+	const int kMaxKeyWords = 11;
+
+	inline uint32_t float_bits(float value)
+	{
+		value += 0.0f;	// -0 and +0 weld
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline uint64_t hash_key(const uint32_t* key, int words)
+	{
+		uint64_t h = 0xCBF29CE484222325ull;
+		for(int i=0; i<words; ++i)
+		{
+			h = (h ^ key[i]) * 0x100000001B3ull;
+		}
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	class WeldKeys
+	{
+	public:
+
+		WeldKeys(const float* positions, const float* normals, const float* uvs, float epsilon)
+			: positions(positions)
+			, normals(normals)
+			, uvs(uvs)
+			, inverseEpsilon(epsilon > 0.0f ? 1.0 / epsilon : 0.0)
+		{
+		}
+
+		int make(size_t vertex, uint32_t* key) const
+		{
+			int words = 0;
+			const float* p = positions + vertex * 3;
+			for(int a=0; a<3; ++a)
+			{
+				if(inverseEpsilon > 0.0)
+				{
+					// Snapped to the nearest multiple of epsilon, so data written on
+					// such a grid never straddles a cell border. Values too large
+					// for a cell (or nan) are compared by their bits. 
+					const double cell = std::floor(p[a] * inverseEpsilon + 0.5);
+					const int64_t index = (cell > -9.0e18 && cell < 9.0e18) ? static_cast<int64_t>(cell) : static_cast<int64_t>(float_bits(p[a]));
+					key[words++] = static_cast<uint32_t>(index);
+					key[words++] = static_cast<uint32_t>(static_cast<uint64_t>(index) >> 32);
+				}
+				else
+				{
+					key[words++] = float_bits(p[a]);
+				}
+			}
+			if(normals)
+			{
+				for(int a=0; a<3; ++a) key[words++] = float_bits(normals[vertex * 3 + a]);
+			}
+			if(uvs)
+			{
+				for(int a=0; a<2; ++a) key[words++] = float_bits(uvs[vertex * 2 + a]);
+			}
+			return words;
+		}
+
+		bool matches(size_t vertex, const uint32_t* key, int words) const
+		{
+			uint32_t other[kMaxKeyWords];
+			make(vertex, other);
+			return std::equal(key, key + words, other);
+		}
+
+	private:
+
+		const float* positions;
+		const float* normals;
+		const float* uvs;
+		double       inverseEpsilon;
+	};
+}
+
+void weld_vertices(const float* positions, const float* normals, const float* uvs, size_t vertexCount, float epsilon, unsigned int threadCount, std::vector<uint32_t>& remap, std::vector<uint32_t>& kept)
+{
+	remap.resize(vertexCount);
+	kept.clear();
+	if(vertexCount == 0)
+	{
+		return;
+	}
+
+	const WeldKeys keys(positions, normals, uvs, epsilon);
+
+	// Open addressing table at most half full. Each used slot holds the
+	// lowest vertex id of one class, so the outcome does not depend on which
+	// thread got there first. 
+	size_t capacity = 16;
+	while(capacity < vertexCount * 2) capacity <<= 1;
+	const size_t mask = capacity - 1;
+	std::unique_ptr<std::atomic<uint32_t>[]> slots(new std::atomic<uint32_t>[capacity]);
+	tinyply::parallel_for(capacity, threadCount, kMinVerticesPerTask, [&](size_t first, size_t last)
+	{
+		for(size_t i=first; i<last; ++i)
+		{
+			slots[i].store(kEmptySlot, std::memory_order_relaxed);
+		}
+	});
+
+	// First the slot of every vertex, then its representative. 
+	std::vector<uint32_t> representative(vertexCount);
+	tinyply::parallel_for(vertexCount, threadCount, kMinVerticesPerTask, [&](size_t first, size_t last)
+	{
+		uint32_t key[kMaxKeyWords];
+		for(size_t v=first; v<last; ++v)
+		{
+			const uint32_t id = static_cast<uint32_t>(v);
+			const int words = keys.make(v, key);
+			size_t slot = static_cast<size_t>(hash_key(key, words)) & mask;
+			uint32_t current = slots[slot].load();
+			for(;;)
+			{
+				if(current == kEmptySlot)
+				{
+					if(slots[slot].compare_exchange_weak(current, id)) break;
+					continue;
+				}
+				if(keys.matches(current, key, words))
+				{
+					while(id < current && !slots[slot].compare_exchange_weak(current, id)) {}
+					break;
+				}
+				slot = (slot + 1) & mask;
+				current = slots[slot].load();
+			}
+			representative[v] = static_cast<uint32_t>(slot);
+		}
+	});
+	tinyply::parallel_for(vertexCount, threadCount, kMinVerticesPerTask, [&](size_t first, size_t last)
+	{
+		for(size_t v=first; v<last; ++v)
+		{
+			representative[v] = slots[representative[v]].load(std::memory_order_relaxed);
+		}
+	});
+	slots.reset();
+
+	// Number the representatives in input order: count per block, offset the
+	// blocks, then fill. 
+	const size_t blockCount = (vertexCount + kMinVerticesPerTask - 1) / kMinVerticesPerTask;
+	std::vector<size_t> blockOffsets(blockCount + 1, 0);
+	tinyply::parallel_for(blockCount, threadCount, 1, [&](size_t first, size_t last)
+	{
+		for(size_t b=first; b<last; ++b)
+		{
+			const size_t end = std::min(vertexCount, (b + 1) * kMinVerticesPerTask);
+			size_t count = 0;
+			for(size_t v=b * kMinVerticesPerTask; v<end; ++v)
+			{
+				count += (representative[v] == v);
+			}
+			blockOffsets[b + 1] = count;
+		}
+	});
+	for(size_t b=0; b<blockCount; ++b)
+	{
+		blockOffsets[b + 1] += blockOffsets[b];
+	}
+
+	kept.resize(blockOffsets[blockCount]);
+	tinyply::parallel_for(blockCount, threadCount, 1, [&](size_t first, size_t last)
+	{
+		for(size_t b=first; b<last; ++b)
+		{
+			const size_t end = std::min(vertexCount, (b + 1) * kMinVerticesPerTask);
+			size_t next = blockOffsets[b];
+			for(size_t v=b * kMinVerticesPerTask; v<end; ++v)
+			{
+				if(representative[v] != v) continue;
+				kept[next] = static_cast<uint32_t>(v);
+				remap[v] = static_cast<uint32_t>(next++);
+			}
+		}
+	});
+	tinyply::parallel_for(vertexCount, threadCount, kMinVerticesPerTask, [&](size_t first, size_t last)
+	{
+		for(size_t v=first; v<last; ++v)
+		{
+			if(representative[v] != v) remap[v] = remap[representative[v]];
+		}
+	});
+}
+
+void remap_indices(const std::vector<uint32_t>& remap, int* indices, size_t count, unsigned int threadCount)
+{
+	tinyply::parallel_for(count, threadCount, kMinVerticesPerTask, [&](size_t first, size_t last)
+	{
+		for(size_t i=first; i<last; ++i)
+		{
+			const int index = indices[i];
+			if(index >= 0 && static_cast<size_t>(index) < remap.size())
+			{
+				indices[i] = static_cast<int>(remap[index]);
+			}
+		}
+	});
+}
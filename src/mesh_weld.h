@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Finds vertices that share a position and, when normals or uvs are given,
+// the same normal and uv. With an epsilon above zero positions are snapped
+// to a grid of that spacing first, otherwise they are compared bit for bit. 
+// remap receives the welded id of every input vertex; kept receives the
+// input id of every welded vertex, in order of first use. 
+void weld_vertices(const float* positions, const float* normals, const float* uvs, size_t vertexCount, float epsilon, unsigned int threadCount, std::vector<uint32_t>& remap, std::vector<uint32_t>& kept);
+
+// Rewrites vertex indices through remap. Indices outside remap are left as
+// they are. 
+void remap_indices(const std::vector<uint32_t>& remap, int* indices, size_t count, unsigned int threadCount);
@@ -4,17 +4,21 @@
 #include <maya/MFnPlugin.h>
 
 #include "ply_translator.h"
+#include "ply_info_command.h"
+#include "ply_stats_command.h"
+#include "ply_batch_command.h"
 
 #define PLUGIN_VENDOR   "oteguro"
 #define PLUGIN_VERSION  "0.1"
 #define TRANSLATOR_NAME "ply_translator"
+#define TRANSLATOR_DEFAULT_OPTIONS "threads=0;format=binary_little_endian;decimation=none;maxPoints=0;voxelSize=0;chunkPoints=1048576;tileFaces=0;weld=0;weldEpsilon=0;weldNormals=1;weldUVs=1;cache=0;compression=;compressionLevel=-1;compact=0;indexType=;positionType=float;normalType=float;uvs=;statsLog="
 
 MStatus initializePlugin(MObject obj)
 {
 	MStatus   status;
 	MFnPlugin plugin(obj, PLUGIN_VENDOR, PLUGIN_VERSION);
 
-	status = plugin.registerFileTranslator(TRANSLATOR_NAME, NULL, PlyTranslator::creator, NULL, NULL, false);
+	status = plugin.registerFileTranslator(TRANSLATOR_NAME, NULL, PlyTranslator::creator, NULL, TRANSLATOR_DEFAULT_OPTIONS, false);
 
 	if(!status)
 	{
@@ -22,6 +26,30 @@ MStatus initializePlugin(MObject obj)
 		return status;
 	}
 
+	status = plugin.registerCommand(PlyInfoCommand::commandName, PlyInfoCommand::creator, PlyInfoCommand::newSyntax);
+
+	if(!status)
+	{
+		status.perror("registerCommand");
+		return status;
+	}
+
+	status = plugin.registerCommand(PlyStatsCommand::commandName, PlyStatsCommand::creator, PlyStatsCommand::newSyntax);
+
+	if(!status)
+	{
+		status.perror("registerCommand");
+		return status;
+	}
+
+	status = plugin.registerCommand(PlyBatchCommand::commandName, PlyBatchCommand::creator, PlyBatchCommand::newSyntax);
+
+	if(!status)
+	{
+		status.perror("registerCommand");
+		return status;
+	}
+
 	return status;
 }
 
@@ -38,5 +66,29 @@ MStatus uninitializePlugin(MObject obj)
 		return status;
 	}
 
+	status = plugin.deregisterCommand(PlyInfoCommand::commandName);
+
+	if (!status)
+	{
+		status.perror("deregisterCommand");
+		return status;
+	}
+
+	status = plugin.deregisterCommand(PlyStatsCommand::commandName);
+
+	if (!status)
+	{
+		status.perror("deregisterCommand");
+		return status;
+	}
+
+	status = plugin.deregisterCommand(PlyBatchCommand::commandName);
+
+	if (!status)
+	{
+		status.perror("deregisterCommand");
+		return status;
+	}
+
 	return status;
 }
@@ -0,0 +1,239 @@
+#include "ply_batch_command.h"
+#include "ply_translator.h"
+#include "ply_mesh_data.h"
+#include "geometry_cache.h"
+#include "io_stats.h"
+#include "../external/tinyply/tinyply.h"
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdlib>
+
+#include <maya/MArgDatabase.h>
+#include <maya/MGlobal.h>
+#include <maya/MString.h>
+#include <maya/MStringArray.h>
+#include <maya/MFnTransform.h>
+
+namespace
+{
+	const char* const kThreadsFlag        = "-t";
+	const char* const kThreadsFlagLong    = "-threads";
+	const char* const kNoCacheFlag        = "-nc";
+	const char* const kNoCacheFlagLong    = "-noCache";
+	const char* const kCacheDirFlag       = "-cd";
+	const char* const kCacheDirFlagLong   = "-cacheDir";
+	const char* const kCacheSizeFlag      = "-cs";
+	const char* const kCacheSizeFlagLong  = "-cacheSize";
+	const char* const kClearCacheFlag     = "-cc";
+	const char* const kClearCacheFlagLong = "-clearCache";
+
+	// Parsed meshes waiting for this thread, per worker. Bounds the memory
+	// held when creating the meshes is slower than parsing them.
+	const size_t kPendingPerWorker = 2;
+
+	struct BatchResult
+	{
+		BatchResult() : file(0), cacheHit(false) {}
+
+		size_t               file;
+		GeometryCache::Entry mesh;
+		bool                 cacheHit;
+		std::string          error;
+	};
+
+	// File name without directories and without .ply (and .gz or .zst),
+	// made a valid Maya node name.
+	MString node_name(const std::string& path)
+	{
+		std::string name = path.substr(path.find_last_of("/\\") + 1);
+		name = name.substr(0, name.find('.'));
+		for(size_t i=0; i<name.size(); ++i)
+		{
+			const char c = name[i];
+			const bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+			if(!valid) name[i] = '_';
+		}
+		if(name.empty() || (name[0] >= '0' && name[0] <= '9'))
+		{
+			name = "ply_" + name;
+		}
+		return MString(name.c_str());
+	}
+}
+
+MString const PlyBatchCommand::commandName("plyImportBatch");
+
+void* PlyBatchCommand::creator()
+{
+	return new PlyBatchCommand();
+}
+
+MSyntax PlyBatchCommand::newSyntax()
+{
+	MSyntax syntax;
+	syntax.addFlag(kThreadsFlag, kThreadsFlagLong, MSyntax::kUnsigned);
+	syntax.addFlag(kNoCacheFlag, kNoCacheFlagLong);
+	syntax.addFlag(kCacheDirFlag, kCacheDirFlagLong, MSyntax::kString);
+	syntax.addFlag(kCacheSizeFlag, kCacheSizeFlagLong, MSyntax::kUnsigned);
+	syntax.addFlag(kClearCacheFlag, kClearCacheFlagLong);
+	syntax.setObjectType(MSyntax::kStringObjects, 0);
+	return syntax;
+}
+
+MStatus PlyBatchCommand::doIt(const MArgList& args)
+{
+	MStatus status;
+	MArgDatabase argData(syntax(), args, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+
+	MStringArray files;
+	CHECK_MSTATUS_AND_RETURN_IT(argData.getObjects(files));
+	std::vector<std::string> paths;
+	for(unsigned int i=0; i<files.length(); ++i)
+	{
+		paths.push_back(files[i].asChar());
+	}
+
+	// 0 uses every hardware thread.
+	unsigned int threadCount = 0;
+	if(argData.isFlagSet(kThreadsFlag))
+	{
+		argData.getFlagArgument(kThreadsFlag, 0, threadCount);
+	}
+	const bool useCache = !argData.isFlagSet(kNoCacheFlag);
+	if(argData.isFlagSet(kClearCacheFlag))
+	{
+		geometry_cache().clear();
+	}
+	if(argData.isFlagSet(kCacheDirFlag))
+	{
+		MString directory;
+		argData.getFlagArgument(kCacheDirFlag, 0, directory);
+		geometry_cache().set_directory(directory.asChar());
+	}
+	if(argData.isFlagSet(kCacheSizeFlag))
+	{
+		unsigned int megabytes = 0;
+		argData.getFlagArgument(kCacheSizeFlag, 0, megabytes);
+		geometry_cache().set_max_bytes(static_cast<size_t>(megabytes) << 20);
+	}
+
+	// Files are spread over the workers; a file gets more than one thread
+	// only when there are fewer files than threads.
+	const unsigned int hardwareThreads = tinyply::resolve_thread_count(threadCount);
+	const unsigned int workerCount = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(hardwareThreads, paths.size())));
+	const unsigned int fileThreads = std::max(1u, hardwareThreads / workerCount);
+
+	IoStats& stats = last_io_stats();
+	stats.begin("batchImport", paths.empty() ? std::string() : paths.front());
+	stats.add("files", static_cast<int64_t>(paths.size()));
+
+	std::mutex              mutex;
+	std::condition_variable changed;
+	std::deque<BatchResult> finished;
+	size_t                  nextFile = 0;
+	bool                    cancelled = false;
+
+	std::vector<std::thread> workers;
+	for(unsigned int w=0; w<workerCount; ++w)
+	{
+		workers.emplace_back([&]()
+		{
+			for(;;)
+			{
+				BatchResult result;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					changed.wait(lock, [&]() { return cancelled || finished.size() < workerCount * kPendingPerWorker; });
+					if(cancelled || nextFile >= paths.size()) return;
+					result.file = nextFile++;
+				}
+				try
+				{
+					result.mesh = load_mesh_arrays(paths[result.file], fileThreads, useCache, &result.cacheHit);
+				}
+				catch (const std::exception& e)
+				{
+					result.error = e.what();
+				}
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					finished.push_back(result);
+				}
+				changed.notify_all();
+			}
+		});
+	}
+
+	// Meshes are created here, in the order they finish, while the workers
+	// go on parsing.
+	MStringArray names;
+	for(size_t done=0; done<paths.size() && status; ++done)
+	{
+		BatchResult result;
+		{
+			IoStats::Phase waitPhase(stats, "wait");
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [&]() { return !finished.empty(); });
+			result = finished.front();
+			finished.pop_front();
+		}
+		changed.notify_all();
+
+		const MString fileName(paths[result.file].c_str());
+		if(!result.error.empty())
+		{
+			MGlobal::displayWarning(MString("Failed to read ply file ") + fileName + ": " + result.error.c_str());
+			continue;
+		}
+		if(!result.mesh || result.mesh->polygonCounts.empty())
+		{
+			MGlobal::displayWarning(MString("No polygons in ply file ") + fileName);
+			continue;
+		}
+		stats.add("cacheHits", result.cacheHit ? 1 : 0);
+		stats.add("vertices", static_cast<int64_t>(result.mesh->positions.size() / 3));
+		stats.add("faces", static_cast<int64_t>(result.mesh->polygonCounts.size()));
+
+		IoStats::Phase createPhase(stats, "create");
+		MFnTransform transformFn;
+		MObject transform = transformFn.create(MObject::kNullObj, &status);
+		if(status)
+		{
+			transformFn.setName(node_name(paths[result.file]));
+			create_ply_mesh(*result.mesh, transform, threadCount, &status);
+		}
+		if(!status)
+		{
+			MGlobal::displayError(MString("Failed to create mesh of ") + fileName);
+			break;
+		}
+		stats.add("meshes", 1);
+		names.append(transformFn.name());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		cancelled = true;
+	}
+	changed.notify_all();
+	for(size_t w=0; w<workers.size(); ++w)
+	{
+		workers[w].join();
+	}
+	stats.end(status == MS::kSuccess);
+	const char* logPath = std::getenv("PLY_TRANSLATOR_STATS_LOG");
+	if(logPath && *logPath && !stats.append_to_log(logPath))
+	{
+		MGlobal::displayWarning(MString("Failed to append ply stats to ") + logPath);
+	}
+
+	setResult(names);
+	return status;
+}
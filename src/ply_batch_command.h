@@ -0,0 +1,27 @@
+#pragma once
+
+#include <maya/MStatus.h>
+#include <maya/MPxCommand.h>
+#include <maya/MSyntax.h>
+#include <maya/MArgList.h>
+
+// plyImportBatch [-threads count] [-noCache] [-cacheDir "dir"] [-cacheSize mb] [-clearCache] "a.ply" "b.ply" ...
+// Imports many ply files at once. A pool of workers parses and converts the
+// files concurrently while this thread creates the meshes as they become
+// ready, one transform per file named after it. Decoded meshes go through
+// the geometry cache, so files imported before are not parsed again while
+// they keep their size and modification time; -cacheDir also keeps them on
+// disk across sessions. -clearCache empties the cache in memory first, and
+// may be given without files. Returns the names of the created transforms.
+class PlyBatchCommand : public MPxCommand
+{
+public:
+
+	MStatus doIt(const MArgList& args);
+
+	static void*   creator();
+	static MSyntax newSyntax();
+
+	static MString const commandName;
+
+}; // class PlyBatchCommand
@@ -0,0 +1,183 @@
+#include "ply_encoding.h"
+
+#include <sstream>
+#include <locale>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+
+namespace
+{
+	// Below this many items per task a thread costs more than it saves.
+	const size_t kMinItemsPerTask = 1 << 16;
+
+	const double kPositionSteps = 65535.0;
+
+	const tinyply::PlyProperty* find_property(tinyply::PlyFile& file, const std::string& element, const std::string& name)
+	{
+		for(auto& e : file.get_elements())
+		{
+			if(e.name != element) continue;
+			for(auto& p : e.properties)
+			{
+				if(p.name == name) return &p;
+			}
+		}
+		return nullptr;
+	}
+
+	bool is_integer(tinyply::PlyProperty::Type type)
+	{
+		return type != tinyply::PlyProperty::Type::FLOAT32 && type != tinyply::PlyProperty::Type::FLOAT64 && type != tinyply::PlyProperty::Type::INVALID;
+	}
+}
+
+const char* const kQuantizedBoundsComment = "quantized_position_bounds";
+
+std::string quantized_bounds_comment(const float boundsMin[3], const float boundsMax[3])
+{
+	std::ostringstream comment;
+	comment.imbue(std::locale::classic());
+	comment.precision(9);
+	comment << kQuantizedBoundsComment;
+	for(int a=0; a<3; ++a) comment << " " << boundsMin[a];
+	for(int a=0; a<3; ++a) comment << " " << boundsMax[a];
+	return comment.str();
+}
+
+bool find_quantized_bounds(const tinyply::PlyFile& file, float boundsMin[3], float boundsMax[3])
+{
+	for(size_t i=0; i<file.comments.size(); ++i)
+	{
+		std::istringstream comment(file.comments[i]);
+		comment.imbue(std::locale::classic());
+		std::string key;
+		comment >> key;
+		if(key != kQuantizedBoundsComment) continue;
+		comment >> boundsMin[0] >> boundsMin[1] >> boundsMin[2] >> boundsMax[0] >> boundsMax[1] >> boundsMax[2];
+		return !comment.fail();
+	}
+	return false;
+}
+
+void request_dequantization(tinyply::PlyFile& file)
+{
+	static const char* const axes[3]    = { "x", "y", "z" };
+	static const char* const normals[3] = { "nx", "ny", "nz" };
+
+	float boundsMin[3];
+	float boundsMax[3];
+	const bool quantized = find_quantized_bounds(file, boundsMin, boundsMax);
+	for(int a=0; a<3; ++a)
+	{
+		const tinyply::PlyProperty* position = find_property(file, "vertex", axes[a]);
+		if(quantized && position && is_integer(position->propertyType))
+		{
+			const double scale = (static_cast<double>(boundsMax[a]) - boundsMin[a]) * tinyply::normalizing_scale(position->propertyType);
+			file.set_property_scale("vertex", axes[a], scale, boundsMin[a]);
+		}
+		const tinyply::PlyProperty* normal = find_property(file, "vertex", normals[a]);
+		if(normal && is_integer(normal->propertyType))
+		{
+			file.normalize_property("vertex", normals[a]);
+		}
+	}
+}
+
+void quantize_positions(const std::vector<float>& positions, std::vector<uint16_t>& quantized, float boundsMin[3], float boundsMax[3], unsigned int threadCount)
+{
+	const size_t count = positions.size() / 3;
+	for(int a=0; a<3; ++a)
+	{
+		boundsMin[a] = count ? std::numeric_limits<float>::max() : 0.0f;
+		boundsMax[a] = count ? -std::numeric_limits<float>::max() : 0.0f;
+	}
+	for(size_t i=0; i<count; ++i)
+	{
+		for(int a=0; a<3; ++a)
+		{
+			boundsMin[a] = std::min(boundsMin[a], positions[i*3+a]);
+			boundsMax[a] = std::max(boundsMax[a], positions[i*3+a]);
+		}
+	}
+
+	double inverseStep[3];
+	for(int a=0; a<3; ++a)
+	{
+		const double extent = static_cast<double>(boundsMax[a]) - boundsMin[a];
+		inverseStep[a] = (extent > 0.0) ? kPositionSteps / extent : 0.0;
+	}
+
+	quantized.resize(count * 3);
+	tinyply::parallel_for(count, threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+	{
+		for(size_t i=first; i<last; ++i)
+		{
+			for(int a=0; a<3; ++a)
+			{
+				const double step = (positions[i*3+a] - boundsMin[a]) * inverseStep[a];
+				quantized[i*3+a] = static_cast<uint16_t>(std::min(kPositionSteps, std::max(0.0, std::floor(step + 0.5))));
+			}
+		}
+	});
+}
+
+template<typename T>
+void quantize_normals(const std::vector<float>& normals, std::vector<T>& quantized, unsigned int threadCount)
+{
+	const float range = static_cast<float>(std::numeric_limits<T>::max());
+	quantized.resize(normals.size());
+	tinyply::parallel_for(normals.size(), threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+	{
+		for(size_t i=first; i<last; ++i)
+		{
+			const float value = std::min(1.0f, std::max(-1.0f, normals[i]));
+			quantized[i] = static_cast<T>(std::floor(value * range + 0.5f));
+		}
+	});
+}
+
+template void quantize_normals<int8_t>(const std::vector<float>&, std::vector<int8_t>&, unsigned int);
+template void quantize_normals<int16_t>(const std::vector<float>&, std::vector<int16_t>&, unsigned int);
+
+template<typename T>
+void narrow_indices(const std::vector<int32_t>& indices, std::vector<T>& narrowed, unsigned int threadCount)
+{
+	narrowed.resize(indices.size());
+	tinyply::parallel_for(indices.size(), threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+	{
+		for(size_t i=first; i<last; ++i)
+		{
+			narrowed[i] = static_cast<T>(indices[i]);
+		}
+	});
+}
+
+template void narrow_indices<uint16_t>(const std::vector<int32_t>&, std::vector<uint16_t>&, unsigned int);
+template void narrow_indices<uint32_t>(const std::vector<int32_t>&, std::vector<uint32_t>&, unsigned int);
+
+int drop_opaque_alpha(std::vector<uint8_t>& rgba, unsigned int threadCount)
+{
+	const size_t count = rgba.size() / 4;
+	std::atomic<bool> opaque(true);
+	tinyply::parallel_for(count, threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+	{
+		for(size_t i=first; i<last && opaque.load(std::memory_order_relaxed); ++i)
+		{
+			if(rgba[i*4+3] != 255) opaque = false;
+		}
+	});
+	if(!opaque)
+	{
+		return 4;
+	}
+	for(size_t i=0; i<count; ++i)
+	{
+		rgba[i*3]   = rgba[i*4];
+		rgba[i*3+1] = rgba[i*4+1];
+		rgba[i*3+2] = rgba[i*4+2];
+	}
+	rgba.resize(count * 3);
+	return 3;
+}
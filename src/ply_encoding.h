@@ -0,0 +1,41 @@
+#pragma once
+
+#include "../external/tinyply/tinyply.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Compact encodings of exported attributes and their decoding on import.
+// Quantized positions are ushort steps across a bounding box that is
+// declared in a header comment; normals may be normalized shorts or chars.
+
+// Header comment declaring the box of quantized positions, e.g.
+// "quantized_position_bounds -1 -1 -1 1 1 1".
+extern const char* const kQuantizedBoundsComment;
+
+std::string quantized_bounds_comment(const float boundsMin[3], const float boundsMax[3]);
+
+// Finds the box declared in the comments of file.
+bool find_quantized_bounds(const tinyply::PlyFile& file, float boundsMin[3], float boundsMax[3]);
+
+// Makes the requested vertex attributes of file decode to floats again:
+// integer positions are mapped back into the declared box and integer
+// normals to [-1, 1]. Call it once the properties are requested.
+void request_dequantization(tinyply::PlyFile& file);
+
+// Maps xyz positions onto 0..65535 along each axis of their bounding box,
+// which is returned.
+void quantize_positions(const std::vector<float>& positions, std::vector<uint16_t>& quantized, float boundsMin[3], float boundsMax[3], unsigned int threadCount);
+
+// Maps values in [-1, 1] onto the full range of a signed integer type.
+template<typename T>
+void quantize_normals(const std::vector<float>& normals, std::vector<T>& quantized, unsigned int threadCount);
+
+// Copies indices into a narrower type that holds all of them.
+template<typename T>
+void narrow_indices(const std::vector<int32_t>& indices, std::vector<T>& narrowed, unsigned int threadCount);
+
+// Drops the alpha of rgba bytes when every alpha is opaque. Returns the
+// channels left.
+int drop_opaque_alpha(std::vector<uint8_t>& rgba, unsigned int threadCount);
@@ -0,0 +1,273 @@
+#include "ply_info_command.h"
+#include "compressed_stream.h"
+#include "ply_encoding.h"
+#include "geometry_cache.h"
+#include "../external/tinyply/tinyply.h"
+
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+
+#include <maya/MArgDatabase.h>
+#include <maya/MGlobal.h>
+#include <maya/MString.h>
+
+namespace
+{
+	const char* const kIndexFlag      = "-i";
+	const char* const kIndexFlagLong  = "-index";
+	const char* const kSampleFlag     = "-s";
+	const char* const kSampleFlagLong = "-sample";
+
+	// Sidecar indices sit next to the file they describe. 
+	const char* const kIndexExtension = ".plyidx";
+
+	// Records decoded at a time while the index scans the vertices. 
+	const size_t kIndexChunkRecords = 1 << 20;
+
+	std::string json_string(const std::string& text)
+	{
+		std::string quoted("\"");
+		for(size_t i=0; i<text.size(); ++i)
+		{
+			const unsigned char c = static_cast<unsigned char>(text[i]);
+			if(c == '"' || c == '\\')
+			{
+				quoted += '\\';
+				quoted += static_cast<char>(c);
+			}
+			else if(c < 0x20)
+			{
+				static const char hex[] = "0123456789abcdef";
+				quoted += "\\u00";
+				quoted += hex[c >> 4];
+				quoted += hex[c & 15];
+			}
+			else
+			{
+				quoted += static_cast<char>(c);
+			}
+		}
+		return quoted + "\"";
+	}
+
+	void write_string_list(std::ostream& os, const std::vector<std::string>& list)
+	{
+		os << "[";
+		for(size_t i=0; i<list.size(); ++i)
+		{
+			os << (i ? "," : "") << json_string(list[i]);
+		}
+		os << "]";
+	}
+
+	const char* format_name(const tinyply::PlyFile& file)
+	{
+		if(!file.is_binary()) return "ascii";
+		return file.is_big_endian() ? "binary_big_endian" : "binary_little_endian";
+	}
+
+	void write_header_info(std::ostream& os, tinyply::PlyFile& file)
+	{
+		const std::vector<int64_t> offsets = file.get_element_offsets();
+		os << "\"format\":" << json_string(format_name(file));
+		os << ",\"headerSize\":" << file.get_header_size();
+		os << ",\"comments\":";
+		write_string_list(os, file.comments);
+		os << ",\"objInfo\":";
+		write_string_list(os, file.objInfo);
+		os << ",\"elements\":[";
+		for(size_t i=0; i<file.get_elements().size(); ++i)
+		{
+			const tinyply::PlyElement& e = file.get_elements()[i];
+			os << (i ? "," : "") << "{\"name\":" << json_string(e.name) << ",\"count\":" << e.size << ",\"offset\":" << offsets[i] << ",\"properties\":[";
+			for(size_t j=0; j<e.properties.size(); ++j)
+			{
+				const tinyply::PlyProperty& p = e.properties[j];
+				os << (j ? "," : "") << "{\"name\":" << json_string(p.name) << ",\"type\":" << json_string(tinyply::PropertyTable[p.propertyType].str);
+				if(p.isList)
+				{
+					os << ",\"listType\":" << json_string(tinyply::PropertyTable[p.listType].str);
+				}
+				os << "}";
+			}
+			os << "]}";
+		}
+		os << "]";
+	}
+
+	// Scans the body once: offsets of every element, then the vertex
+	// positions a chunk at a time for their bounds and a strided sample. 
+	void write_body_index(std::ostream& os, tinyply::PlyFile& file, const std::string& path, size_t sampleCount)
+	{
+		tinyply::MemoryMappedFile mappedFile(path);
+
+		const std::vector<int64_t> offsets = file.find_element_offsets(mappedFile);
+		os << ",\"offsets\":[";
+		for(size_t i=0; i<offsets.size(); ++i)
+		{
+			os << (i ? "," : "") << offsets[i];
+		}
+		os << "]";
+
+		int64_t vertexCount = 0;
+		bool fixedStride = false;
+		for(auto& e : file.get_elements())
+		{
+			if(e.name != "vertex") continue;
+			vertexCount = e.size;
+			fixedStride = std::none_of(e.properties.begin(), e.properties.end(), [](const tinyply::PlyProperty& p) { return p.isList; });
+		}
+
+		std::vector<float> positions;
+		if(vertexCount == 0 || !fixedStride || file.request_properties_from_element("vertex", { "x", "y", "z" }, positions) == 0)
+		{
+			return;
+		}
+		request_dequantization(file);
+
+		float boundsMin[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		float boundsMax[3] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+		const size_t sampleStride = sampleCount ? std::max<size_t>(1, static_cast<size_t>(vertexCount) / sampleCount) : 0;
+		std::vector<float> sample;
+		sample.reserve(sampleCount * 3);
+
+		file.read_chunked(mappedFile, "vertex", kIndexChunkRecords, [&](size_t first, size_t count)
+		{
+			for(size_t i=0; i<count; ++i)
+			{
+				const float* p = &positions[i * 3];
+				for(int a=0; a<3; ++a)
+				{
+					boundsMin[a] = std::min(boundsMin[a], p[a]);
+					boundsMax[a] = std::max(boundsMax[a], p[a]);
+				}
+				if(sampleStride && (first + i) % sampleStride == 0 && sample.size() < sampleCount * 3)
+				{
+					sample.insert(sample.end(), p, p + 3);
+				}
+			}
+		}, 0);
+
+		os << ",\"bounds\":[" << boundsMin[0] << "," << boundsMin[1] << "," << boundsMin[2] << "," << boundsMax[0] << "," << boundsMax[1] << "," << boundsMax[2] << "]";
+		if(sampleCount)
+		{
+			os << ",\"sample\":[";
+			for(size_t i=0; i<sample.size(); ++i)
+			{
+				os << (i ? "," : "") << sample[i];
+			}
+			os << "]";
+		}
+	}
+}
+
+MString const PlyInfoCommand::commandName("plyInfo");
+
+void* PlyInfoCommand::creator()
+{
+	return new PlyInfoCommand();
+}
+
+MSyntax PlyInfoCommand::newSyntax()
+{
+	MSyntax syntax;
+	syntax.addFlag(kIndexFlag, kIndexFlagLong);
+	syntax.addFlag(kSampleFlag, kSampleFlagLong, MSyntax::kUnsigned);
+	syntax.addArg(MSyntax::kString);
+	return syntax;
+}
+
+MStatus PlyInfoCommand::doIt(const MArgList& args)
+{
+	MStatus status;
+	MArgDatabase argData(syntax(), args, &status);
+	CHECK_MSTATUS_AND_RETURN_IT(status);
+
+	MString fileName;
+	CHECK_MSTATUS_AND_RETURN_IT(argData.getCommandArgument(0, fileName));
+	const std::string path(fileName.asChar());
+
+	const bool writeIndex = argData.isFlagSet(kIndexFlag);
+	unsigned int sampleCount = 0;
+	if(argData.isFlagSet(kSampleFlag))
+	{
+		argData.getFlagArgument(kSampleFlag, 0, sampleCount);
+	}
+
+	int64_t fileSize  = 0;
+	int64_t fileMtime = 0;
+	if(!file_stamp(path, &fileSize, &fileMtime))
+	{
+		MGlobal::displayError(MString("Cannot open ply file: ") + fileName);
+		return MS::kFailure;
+	}
+
+	// The index starts with the stamp of the file it was made from (and the
+	// sample size asked for), so a prefix match tells whether it can be reused. 
+	std::ostringstream stamp;
+	stamp.imbue(std::locale::classic());
+	stamp << "{\"size\":" << fileSize << ",\"mtime\":" << fileMtime << ",\"sampleCount\":" << sampleCount << ",";
+	const std::string indexPath = path + kIndexExtension;
+
+	try
+	{
+		if(writeIndex)
+		{
+			std::ifstream cached(indexPath.c_str(), std::ios::binary);
+			const std::string text((std::istreambuf_iterator<char>(cached)), std::istreambuf_iterator<char>());
+			if(text.compare(0, stamp.str().size(), stamp.str()) == 0)
+			{
+				setResult(MString(text.c_str()));
+				return MS::kSuccess;
+			}
+		}
+
+		// Compressed files have their header decompressed; their body cannot
+		// be mapped, so they get no body index. 
+		const Compression compression = compression_of_file(path);
+		tinyply::PlyFile file;
+		if(compression != kUncompressed)
+		{
+			DecompressingStream is(path, compression);
+			file = tinyply::PlyFile(is);
+		}
+		else
+		{
+			std::ifstream is(path.c_str(), std::ios::binary);
+			file = tinyply::PlyFile(is);
+		}
+
+		std::ostringstream json;
+		json.imbue(std::locale::classic());
+		json.precision(9);
+		json << stamp.str();
+		write_header_info(json, file);
+		if(writeIndex && compression == kUncompressed)
+		{
+			write_body_index(json, file, path, sampleCount);
+		}
+		json << "}";
+
+		if(writeIndex)
+		{
+			std::ofstream index(indexPath.c_str(), std::ios::binary | std::ios::trunc);
+			index << json.str();
+			if(!index)
+			{
+				MGlobal::displayWarning(MString("Failed to write ply index: ") + indexPath.c_str());
+			}
+		}
+		setResult(MString(json.str().c_str()));
+	}
+	catch (const std::exception& e)
+	{
+		MGlobal::displayError(MString("Failed to read ply header: ") + e.what());
+		return MS::kFailure;
+	}
+	return MS::kSuccess;
+}
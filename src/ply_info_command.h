@@ -0,0 +1,25 @@
+#pragma once
+
+#include <maya/MStatus.h>
+#include <maya/MPxCommand.h>
+#include <maya/MSyntax.h>
+#include <maya/MArgList.h>
+
+// plyInfo [-index] [-sample count] "file.ply"
+// Reads only the header of a ply file and returns it as a json string:
+// format, comments, elements with their counts, property types and the
+// byte offset of their bodies. -index also writes a sidecar index next to
+// the file (all body offsets, vertex bounds and a strided point sample),
+// reused for as long as the file keeps its size and modification time. 
+class PlyInfoCommand : public MPxCommand
+{
+public:
+
+	MStatus doIt(const MArgList& args);
+
+	static void*   creator();
+	static MSyntax newSyntax();
+
+	static MString const commandName;
+
+}; // class PlyInfoCommand
@@ -0,0 +1,214 @@
+#include "ply_mesh_data.h"
+#include "ply_encoding.h"
+#include "compressed_stream.h"
+
+#include <fstream>
+#include <algorithm>
+
+namespace
+{
+	// Below this many items per task a thread costs more than it saves. 
+	const size_t kMinItemsPerTask = 1 << 16;
+
+	// Requests the first property set in candidates that the element has. 
+	template<typename T>
+	int64_t request_first_of(tinyply::PlyFile& file, const std::string& element, const std::vector<std::vector<std::string> >& candidates, std::vector<T>& data, int* channels)
+	{
+		for(size_t i=0; i<candidates.size(); ++i)
+		{
+			if(int64_t count = file.request_properties_from_element(element, candidates[i], data))
+			{
+				*channels = static_cast<int>(candidates[i].size());
+				return count;
+			}
+		}
+		return 0;
+	}
+}
+
+PlyMeshData::PlyMeshData()
+	: vertexCount(0)
+	, normalCount(0)
+	, colorCount(0)
+	, uvCount(0)
+	, faceCount(0)
+	, texcoordCount(0)
+	, faceColorCount(0)
+	, tristripCount(0)
+	, colorChannels(0)
+	, faceColorChannels(0)
+	, uvChannels(0)
+{
+}
+
+size_t MeshArrays::byte_size() const
+{
+	return positions.size() * sizeof(float) + polygonCounts.size() * sizeof(int) + polygonConnects.size() * sizeof(int)
+		 + normals.size() * sizeof(float) + colors.size() + faceColors.size()
+		 + cornerUVs.size() * sizeof(float) + vertexUVs.size() * sizeof(float);
+}
+
+void request_mesh_data(tinyply::PlyFile& file, PlyMeshData& data)
+{
+	std::vector<std::vector<std::string> > colorKeys;
+	colorKeys.push_back({ "red", "green", "blue", "alpha" });
+	colorKeys.push_back({ "red", "green", "blue" });
+	std::vector<std::vector<std::string> > uvKeys;
+	uvKeys.push_back({ "u", "v" });
+	uvKeys.push_back({ "s", "t" });
+	uvKeys.push_back({ "texture_u", "texture_v" });
+
+	data.vertexCount     = file.request_properties_from_element("vertex", { "x", "y", "z" },    data.vertices);
+	data.normalCount     = file.request_properties_from_element("vertex", { "nx", "ny", "nz" }, data.normals);
+	data.colorCount      = request_color_bytes(file, "vertex", colorKeys, data.colors, &data.colorChannels);
+	data.uvCount         = request_first_of(file, "vertex", uvKeys, data.uvs, &data.uvChannels);
+	data.faceCount       = file.request_list_property_from_element("face", "vertex_indices", data.faceOffsets, data.faces);
+	data.texcoordCount   = file.request_list_property_from_element("face", "texcoord", data.texcoordOffsets, data.texcoords);
+	data.faceColorCount  = request_color_bytes(file, "face", colorKeys, data.faceColors, &data.faceColorChannels);
+	data.tristripCount   = file.request_list_property_from_element("tristrips", "vertex_indices", data.stripOffsets, data.stripIndices);
+	request_dequantization(file);
+}
+
+int64_t request_color_bytes(tinyply::PlyFile& file, const std::string& element, const std::vector<std::vector<std::string> >& candidates, std::vector<uint8_t>& data, int* channels)
+{
+	for(size_t i=0; i<candidates.size(); ++i)
+	{
+		const int64_t count = file.request_properties_from_element(element, candidates[i], data);
+		if(count == 0) continue;
+
+		*channels = static_cast<int>(candidates[i].size());
+		for(auto& e : file.get_elements())
+		{
+			if(e.name != element) continue;
+			for(auto& p : e.properties)
+			{
+				if(p.propertyType == tinyply::PlyProperty::Type::UINT8) continue;
+				if(std::find(candidates[i].begin(), candidates[i].end(), p.name) == candidates[i].end()) continue;
+				const bool isReal = p.propertyType == tinyply::PlyProperty::Type::FLOAT32 || p.propertyType == tinyply::PlyProperty::Type::FLOAT64;
+				file.set_property_scale(element, p.name, isReal ? 255.0 : 255.0 * tinyply::normalizing_scale(p.propertyType));
+			}
+		}
+		return count;
+	}
+	return 0;
+}
+
+uint32_t build_polygons(PlyMeshData& data, std::vector<int>& polygonCounts, std::vector<int>& polygonConnects, unsigned int threadCount)
+{
+	if(data.faceCount)
+	{
+		// Faces arrive as offsets plus flat indices, so any polygon size
+		// maps straight onto polygonCounts/polygonConnects. 
+		polygonCounts.resize(data.faceCount);
+		tinyply::parallel_for(data.faceCount, threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+		{
+			for(size_t i=first; i<last; ++i)
+			{
+				polygonCounts[i] = static_cast<int>(data.faceOffsets[i + 1] - data.faceOffsets[i]);
+			}
+		});
+		polygonConnects.swap(data.faces);
+		return data.faceCount;
+	}
+	if(data.tristripCount > 0)
+	{
+		decode_tristrips(data.stripIndices, polygonConnects);
+		polygonCounts.assign(polygonConnects.size() / 3, 3);
+		return static_cast<uint32_t>(polygonCounts.size());
+	}
+	polygonCounts.clear();
+	polygonConnects.clear();
+	return 0;
+}
+
+uint32_t build_mesh_arrays(PlyMeshData& data, MeshArrays& mesh, unsigned int threadCount)
+{
+	const bool facesFromFaceElement = (data.faceCount > 0);
+	const uint32_t vertexCount = data.vertexCount;
+	const uint32_t faceCount = build_polygons(data, mesh.polygonCounts, mesh.polygonConnects, threadCount);
+	if(vertexCount == 0 || faceCount == 0)
+	{
+		return faceCount;
+	}
+
+	mesh.positions.swap(data.vertices);
+	if(data.normalCount == vertexCount)
+	{
+		mesh.normals.swap(data.normals);
+	}
+	if(data.colorCount == vertexCount)
+	{
+		mesh.colors.swap(data.colors);
+		mesh.colorChannels = data.colorChannels;
+	}
+	if(facesFromFaceElement && data.faceColorCount == faceCount)
+	{
+		mesh.faceColors.swap(data.faceColors);
+		mesh.faceColorChannels = data.faceColorChannels;
+	}
+	if(facesFromFaceElement && data.texcoordCount == faceCount && data.texcoords.size() == mesh.polygonConnects.size() * 2)
+	{
+		mesh.cornerUVs.swap(data.texcoords);
+	}
+	else if(data.uvCount == vertexCount)
+	{
+		mesh.vertexUVs.swap(data.uvs);
+	}
+	return faceCount;
+}
+
+void read_mesh_arrays(const std::string& path, MeshArrays& mesh, unsigned int threadCount)
+{
+	PlyMeshData data;
+	const Compression compression = compression_of_file(path);
+	if(compression != kUncompressed)
+	{
+		DecompressingStream is(path, compression);
+		tinyply::PlyFile file(is);
+		request_mesh_data(file, data);
+		file.read(is, threadCount);
+	}
+	else
+	{
+		std::ifstream is(path.c_str(), std::ios::binary);
+		tinyply::PlyFile file(is);
+		is.close();
+
+		tinyply::MemoryMappedFile mappedFile(path);
+		request_mesh_data(file, data);
+		file.read(mappedFile, threadCount);
+	}
+	build_mesh_arrays(data, mesh, threadCount);
+}
+
+// A single pass over a presized index buffer. Degenerate triangles are
+// dropped and restart the winding. 
+void decode_tristrips(const std::vector<int>& strips, std::vector<int>& polygonConnects)
+{
+	polygonConnects.resize(strips.size() > 2 ? (strips.size() - 2) * 3 : 0);
+	int* out = polygonConnects.data();
+	int windings = 0;
+
+	for(size_t traceIndex = 2; traceIndex < strips.size(); ++traceIndex)
+	{
+		const int vindex0 = strips[traceIndex - 2];
+		const int vindex1 = strips[traceIndex - 1];
+		const int vindex2 = strips[traceIndex];
+
+		if(vindex0 != vindex1 && vindex1 != vindex2 && vindex0 != vindex2
+		&& vindex0 >= 0 && vindex1 >= 0 && vindex2 >= 0)
+		{
+			const bool even = (windings % 2) == 0;
+			out[0] = even ? vindex0 : vindex2;
+			out[1] = vindex1;
+			out[2] = even ? vindex2 : vindex0;
+			out += 3;
+			windings++;
+		}
+		else
+		{
+			windings = 0;
+		}
+	}
+	polygonConnects.resize(out - polygonConnects.data());
+}
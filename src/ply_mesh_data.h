@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../external/tinyply/tinyply.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Mesh attributes as requested from a ply file, before they become a Maya
+// mesh. Counts are the number of records found for each request, zero when
+// the file does not have it. 
+struct PlyMeshData
+{
+	PlyMeshData();
+
+	uint32_t vertexCount;
+	uint32_t normalCount;
+	uint32_t colorCount;
+	uint32_t uvCount;
+	uint32_t faceCount;
+	uint32_t texcoordCount;
+	uint32_t faceColorCount;
+	uint32_t tristripCount;
+	int      colorChannels;
+	int      faceColorChannels;
+	int      uvChannels;
+
+	std::vector<float>      vertices;
+	std::vector<float>      normals;
+	std::vector<uint8_t>    colors;
+	std::vector<float>      uvs;
+	std::vector<uint32_t>   faceOffsets;
+	std::vector<int>        faces;
+	std::vector<uint32_t>   texcoordOffsets;
+	std::vector<float>      texcoords;
+	std::vector<uint8_t>    faceColors;
+	std::vector<uint32_t>   stripOffsets;
+	std::vector<int>        stripIndices;
+};
+
+// Everything needed to build one Maya mesh. Attribute arrays stay empty
+// when the file does not carry them for every vertex or face. 
+struct MeshArrays
+{
+	MeshArrays() : colorChannels(0), faceColorChannels(0) {}
+
+	// Bytes held by the arrays. 
+	size_t byte_size() const;
+
+	std::vector<float>   positions;         // xyz per vertex
+	std::vector<int>     polygonCounts;
+	std::vector<int>     polygonConnects;
+	std::vector<float>   normals;           // xyz per vertex
+	std::vector<uint8_t> colors;            // colorChannels bytes per vertex
+	std::vector<uint8_t> faceColors;        // faceColorChannels bytes per face
+	std::vector<float>   cornerUVs;         // uv per face corner
+	std::vector<float>   vertexUVs;         // uv per vertex
+	int colorChannels;
+	int faceColorChannels;
+};
+
+// Requests every attribute the translator imports; file.read fills them. 
+// Quantized positions and normals are decoded back to floats. 
+void request_mesh_data(tinyply::PlyFile& file, PlyMeshData& data);
+
+// Requests colors as bytes. Wider or real channels are decoded straight
+// into bytes, scaled so that their full range maps to 0..255. 
+int64_t request_color_bytes(tinyply::PlyFile& file, const std::string& element, const std::vector<std::vector<std::string> >& candidates, std::vector<uint8_t>& data, int* channels);
+
+// Turns the faces, or without faces the triangle strips, into polygon
+// counts and connects. Face indices are moved out of data. Returns the
+// number of polygons. 
+uint32_t build_polygons(PlyMeshData& data, std::vector<int>& polygonCounts, std::vector<int>& polygonConnects, unsigned int threadCount);
+
+// Decodes triangle strips (-1 restarts a strip) into triangles. 
+void decode_tristrips(const std::vector<int>& strips, std::vector<int>& polygonConnects);
+
+// Builds the polygons of data and moves the attributes that cover every
+// vertex or face into mesh. Returns the number of faces. 
+uint32_t build_mesh_arrays(PlyMeshData& data, MeshArrays& mesh, unsigned int threadCount);
+
+// Reads a whole ply file, compressed or not, into mesh. Throws on errors. 
+void read_mesh_arrays(const std::string& path, MeshArrays& mesh, unsigned int threadCount);
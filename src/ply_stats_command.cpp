@@ -0,0 +1,22 @@
+#include "ply_stats_command.h"
+#include "io_stats.h"
+
+#include <maya/MString.h>
+
+MString const PlyStatsCommand::commandName("plyStats");
+
+void* PlyStatsCommand::creator()
+{
+	return new PlyStatsCommand();
+}
+
+MSyntax PlyStatsCommand::newSyntax()
+{
+	return MSyntax();
+}
+
+MStatus PlyStatsCommand::doIt(const MArgList& args)
+{
+	setResult(MString(last_io_stats().to_json().c_str()));
+	return MS::kSuccess;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <maya/MStatus.h>
+#include <maya/MPxCommand.h>
+#include <maya/MSyntax.h>
+#include <maya/MArgList.h>
+
+// plyStats
+// Returns the phase timings and counters of the last ply import or export
+// as a json string, the same line the translator appends to its stats log. 
+class PlyStatsCommand : public MPxCommand
+{
+public:
+
+	MStatus doIt(const MArgList& args);
+
+	static void*   creator();
+	static MSyntax newSyntax();
+
+	static MString const commandName;
+
+}; // class PlyStatsCommand
@@ -1,4 +1,12 @@
 #include "ply_translator.h"
+#include "ply_mesh_data.h"
+#include "point_decimator.h"
+#include "mesh_tiler.h"
+#include "mesh_weld.h"
+#include "io_stats.h"
+#include "compressed_stream.h"
+#include "ply_encoding.h"
+#include "geometry_cache.h"
 #include "../external/tinyply/tinyply.h"
 
 #include <sstream>
@@ -8,11 +16,24 @@
 #include <cstdint>
 #include <thread>
 #include <chrono>
+#include <map>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
 
 #include <maya/MFnMesh.h>
 #include <maya/MFnMeshData.h>
 #include <maya/MPointArray.h>
 #include <maya/MIntArray.h>
+#include <maya/MFloatArray.h>
+#include <maya/MVectorArray.h>
+#include <maya/MColorArray.h>
+#include <maya/MFloatVectorArray.h>
+#include <maya/MFnParticleSystem.h>
+#include <maya/MFnTypedAttribute.h>
+#include <maya/MFnData.h>
+#include <maya/MFnTransform.h>
 
 namespace
 {
@@ -28,8 +49,794 @@ namespace
 		return (double)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
 	}
 
+	// Translator options arrive as "name=value;name=value". 
+	std::map<std::string, std::string> parse_options(const MString& optionsString)
+	{
+		std::map<std::string, std::string> options;
+		MStringArray pairs;
+		optionsString.split(';', pairs);
+		for(unsigned int i=0; i<pairs.length(); ++i)
+		{
+			MStringArray keyValue;
+			pairs[i].split('=', keyValue);
+			if(keyValue.length() == 2)
+			{
+				options[keyValue[0].asChar()] = keyValue[1].asChar();
+			}
+		}
+		return options;
+	}
+
+	int option_as_int(const std::map<std::string, std::string>& options, const std::string& name, int defaultValue)
+	{
+		std::map<std::string, std::string>::const_iterator it = options.find(name);
+		if(it == options.end() || it->second.empty())
+		{
+			return defaultValue;
+		}
+		return atoi(it->second.c_str());
+	}
+
+	double option_as_double(const std::map<std::string, std::string>& options, const std::string& name, double defaultValue)
+	{
+		std::map<std::string, std::string>::const_iterator it = options.find(name);
+		if(it == options.end() || it->second.empty())
+		{
+			return defaultValue;
+		}
+		return atof(it->second.c_str());
+	}
+
+	std::string option_as_string(const std::map<std::string, std::string>& options, const std::string& name, const std::string& defaultValue)
+	{
+		std::map<std::string, std::string>::const_iterator it = options.find(name);
+		if(it == options.end() || it->second.empty())
+		{
+			return defaultValue;
+		}
+		return it->second;
+	}
+
+	// Opens the stats of one import or export and closes them on every
+	// return path. They are appended to the log named by the statsLog option,
+	// or by PLY_TRANSLATOR_STATS_LOG when the option is not set. 
+	class StatsScope
+	{
+	public:
+
+		StatsScope(const char* operation, const MString& path, const std::map<std::string, std::string>& options)
+			: succeeded(false)
+		{
+			const char* environmentLog = std::getenv("PLY_TRANSLATOR_STATS_LOG");
+			logPath = option_as_string(options, "statsLog", environmentLog ? environmentLog : "");
+			last_io_stats().begin(operation, path.asChar());
+		}
+
+		~StatsScope()
+		{
+			last_io_stats().end(succeeded);
+			if(!logPath.empty() && !last_io_stats().append_to_log(logPath))
+			{
+				MGlobal::displayWarning(MString("Failed to append ply stats to ") + logPath.c_str());
+			}
+		}
+
+		MStatus finish(MStatus status)
+		{
+			succeeded = (status == MS::kSuccess);
+			return status;
+		}
+
+	private:
+
+		std::string logPath;
+		bool        succeeded;
+	};
+
+	void add_read_stats(IoStats& stats, const tinyply::PlyReadStats& read)
+	{
+		stats.add("bodyBytes", static_cast<int64_t>(read.bodyBytes));
+		stats.add("elementsDecoded", read.elementsDecoded);
+		stats.add("elementsSkipped", read.elementsSkipped);
+		stats.add("recordsDecoded", static_cast<int64_t>(read.recordsDecoded));
+		stats.add("recordsSkipped", static_cast<int64_t>(read.recordsSkipped));
+		stats.add("destinationResizes", read.destinationResizes);
+		stats.add("destinationBytes", static_cast<int64_t>(read.destinationBytes));
+		stats.set_max("peakDestinationBytes", static_cast<int64_t>(read.peakDestinationBytes));
+	}
+
+	// The compressed size of a file read through a DecompressingStream. 
+	void add_compressed_stats(IoStats& stats, std::istream* is)
+	{
+		if(DecompressingStream* decompressing = dynamic_cast<DecompressingStream*>(is))
+		{
+			stats.add("fileBytes", static_cast<int64_t>(decompressing->compressed_bytes()));
+		}
+	}
+
+	// Below this many items per task a thread costs more than it saves. 
+	const size_t kMinItemsPerTask = 1 << 16;
+
+	int64_t element_size(tinyply::PlyFile& file, const std::string& name)
+	{
+		for(auto& e : file.get_elements())
+		{
+			if(e.name == name) return e.size;
+		}
+		return 0;
+	}
+
+	MPointArray to_point_array(const std::vector<float>& xyz, size_t count, unsigned int threadCount)
+	{
+		std::vector<float> points(count * 4);
+		tinyply::parallel_for(count, threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+		{
+			for(size_t i=first; i<last; ++i)
+			{
+				points[i*4]   = xyz[i*3];
+				points[i*4+1] = xyz[i*3+1];
+				points[i*4+2] = xyz[i*3+2];
+				points[i*4+3] = 1.0f;
+			}
+		});
+		return MPointArray(reinterpret_cast<const float(*)[4]>(points.data()), static_cast<unsigned int>(count));
+	}
+
+	std::vector<int> make_index_list(size_t count, unsigned int threadCount)
+	{
+		std::vector<int> indices(count);
+		tinyply::parallel_for(count, threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+		{
+			for(size_t i=first; i<last; ++i)
+			{
+				indices[i] = static_cast<int>(i);
+			}
+		});
+		return indices;
+	}
+
+	// Expands 8 bit rgb(a) colors to the float rgba layout of MColorArray. 
+	MColorArray to_color_array(const std::vector<uint8_t>& colors, int channels, unsigned int threadCount)
+	{
+		const size_t count = colors.size() / channels;
+		std::vector<float> rgba(count * 4);
+		tinyply::parallel_for(count, threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+		{
+			const float scale = 1.0f / 255.0f;
+			for(size_t i=first; i<last; ++i)
+			{
+				const uint8_t* src = &colors[i * channels];
+				float* dst = &rgba[i * 4];
+				dst[0] = src[0] * scale;
+				dst[1] = src[1] * scale;
+				dst[2] = src[2] * scale;
+				dst[3] = (channels == 4) ? src[3] * scale : 1.0f;
+			}
+		});
+		return MColorArray(reinterpret_cast<const float(*)[4]>(rgba.data()), static_cast<unsigned int>(count));
+	}
+
+	// Point clouds are streamed: the vertex element is decoded a chunk at a
+	// time and decimated on the fly, so memory follows the kept points rather
+	// than the file. The result is a particle shape with per-particle colors. 
+	// Compressed files come without a mapping (mappedFile is null) and are
+	// streamed from is the same way. 
+	MStatus import_point_cloud(tinyply::PlyFile& file, const tinyply::MemoryMappedFile* mappedFile, std::istream* is, const std::map<std::string, std::string>& options, unsigned int threadCount)
+	{
+		const std::string decimation = option_as_string(options, "decimation", "none");
+		PointDecimator::Mode mode = PointDecimator::kKeepAll;
+		if(decimation == "random")
+		{
+			mode = PointDecimator::kRandom;
+		}
+		else if(decimation == "voxel")
+		{
+			mode = PointDecimator::kVoxel;
+		}
+		else if(decimation != "none")
+		{
+			MGlobal::displayError(MString("Unknown point decimation: ") + decimation.c_str());
+			return MS::kFailure;
+		}
+
+		std::vector<float>   positions;
+		std::vector<uint8_t> colors;
+		int colorChannels = 0;
+		std::vector<std::vector<std::string> > colorKeys;
+		colorKeys.push_back({ "red", "green", "blue", "alpha" });
+		colorKeys.push_back({ "red", "green", "blue" });
+
+		if(file.request_properties_from_element("vertex", { "x", "y", "z" }, positions) == 0)
+		{
+			return MS::kFailure;
+		}
+		const bool hasColors = request_color_bytes(file, "vertex", colorKeys, colors, &colorChannels) > 0;
+		request_dequantization(file);
+
+		const uint64_t pointCount = static_cast<uint64_t>(element_size(file, "vertex"));
+		const uint64_t maxPoints  = static_cast<uint64_t>(std::max(0.0, option_as_double(options, "maxPoints", 0.0)));
+		// Without a budget there is nothing to sample down to; keep every point. 
+		if(mode == PointDecimator::kRandom && maxPoints == 0)
+		{
+			mode = PointDecimator::kKeepAll;
+		}
+		PointDecimator decimator(mode, pointCount, maxPoints, option_as_double(options, "voxelSize", 0.0));
+
+		// Decimation runs inside the decode loop; its time is taken out of the
+		// decode phase so the two add up to the loop. 
+		IoStats& stats = last_io_stats();
+		double decimateMilliseconds = 0.0;
+		const size_t chunkPoints = static_cast<size_t>(std::max(1, option_as_int(options, "chunkPoints", 1 << 20)));
+		timepoint decodeStart = now();
+		auto decimate = [&](size_t, size_t count)
+		{
+			timepoint decimateStart = now();
+			decimator.add(positions.data(), hasColors ? colors.data() : nullptr, colorChannels, count, threadCount);
+			decimateMilliseconds += difference_micros(decimateStart, now()) / 1000.0;
+		};
+		if(mappedFile)
+		{
+			file.read_chunked(*mappedFile, "vertex", chunkPoints, decimate, threadCount);
+		}
+		else
+		{
+			file.read_chunked(*is, "vertex", chunkPoints, decimate, threadCount);
+		}
+		stats.add_time("decode", difference_micros(decodeStart, now()) / 1000.0 - decimateMilliseconds);
+		stats.add_time("decimate", decimateMilliseconds);
+		std::vector<float>().swap(positions);
+		std::vector<uint8_t>().swap(colors);
+
+		std::vector<float>   keptPositions;
+		std::vector<uint8_t> keptColors;
+		{
+			IoStats::Phase phase(stats, "decimate");
+			decimator.finish(keptPositions, keptColors);
+		}
+		const size_t keptCount = keptPositions.size() / 3;
+		add_read_stats(stats, file.get_read_stats());
+		stats.add("points", static_cast<int64_t>(pointCount));
+		stats.add("pointsKept", static_cast<int64_t>(keptCount));
+
+#ifdef _DEBUG
+		std::cerr << "\tKept " << keptCount << " of " << pointCount << " points." << std::endl;
+#endif
+		if(keptCount == 0)
+		{
+			if(pointCount > 0)
+			{
+				MGlobal::displayWarning(MString("Decimation kept none of the ") + std::to_string(pointCount).c_str() + " points");
+			}
+			return MS::kSuccess;
+		}
+
+		IoStats::Phase createPhase(stats, "create");
+		MStatus stat;
+		MFnParticleSystem particleFn;
+		particleFn.create(&stat);
+		CHECK_MSTATUS_AND_RETURN_IT(stat);
+		CHECK_MSTATUS(particleFn.emit(to_point_array(keptPositions, keptCount, threadCount)));
+
+		if(!keptColors.empty())
+		{
+			std::vector<float> rgb(keptCount * 3);
+			tinyply::parallel_for(keptCount, threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+			{
+				const float scale = 1.0f / 255.0f;
+				for(size_t i=first; i<last; ++i)
+				{
+					rgb[i*3]   = keptColors[i*4]   * scale;
+					rgb[i*3+1] = keptColors[i*4+1] * scale;
+					rgb[i*3+2] = keptColors[i*4+2] * scale;
+				}
+			});
+
+			// rgbPP is not a default particle attribute; rgbPP0 holds its initial state. 
+			MFnTypedAttribute attrFn;
+			CHECK_MSTATUS(particleFn.addAttribute(attrFn.create("rgbPP", "rgbPP", MFnData::kVectorArray)));
+			CHECK_MSTATUS(particleFn.addAttribute(attrFn.create("rgbPP0", "rgbPP0", MFnData::kVectorArray)));
+			CHECK_MSTATUS(particleFn.setPerParticleAttribute("rgbPP", MVectorArray(reinterpret_cast<const float(*)[3]>(rgb.data()), static_cast<unsigned int>(keptCount))));
+		}
+		CHECK_MSTATUS(particleFn.saveInitialState());
+		return MS::kSuccess;
+	}
+
+	void split_uvs(const std::vector<float>& uvs, std::vector<float>& u, std::vector<float>& v, unsigned int threadCount)
+	{
+		const size_t count = uvs.size() / 2;
+		u.resize(count);
+		v.resize(count);
+		tinyply::parallel_for(count, threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+		{
+			for(size_t i=first; i<last; ++i)
+			{
+				u[i] = uvs[i*2];
+				v[i] = uvs[i*2+1];
+			}
+		});
+	}
+
+	// Creates the mesh under parent (a new transform when null) and applies
+	// its attributes with the batched setters. 
+	MObject create_mesh(const MeshArrays& mesh, MObject parent, unsigned int threadCount, MStatus* status)
+	{
+		const unsigned int vertexCount = static_cast<unsigned int>(mesh.positions.size() / 3);
+		const unsigned int faceCount   = static_cast<unsigned int>(mesh.polygonCounts.size());
+		const unsigned int cornerCount = static_cast<unsigned int>(mesh.polygonConnects.size());
+
+		const MIntArray polygonCounts(mesh.polygonCounts.data(), faceCount);
+		const MIntArray polygonConnects(mesh.polygonConnects.data(), cornerCount);
+
+		MFnMesh meshFn;
+		MObject meshObject = meshFn.create(vertexCount,
+										   faceCount,
+										   to_point_array(mesh.positions, vertexCount, threadCount),
+										   polygonCounts,
+										   polygonConnects,
+										   parent,
+										   status);
+		CHECK_MSTATUS(*status);
+		if(!*status)
+		{
+			return meshObject;
+		}
+
+		if(!mesh.normals.empty() || !mesh.colors.empty())
+		{
+			std::vector<int> indices = make_index_list(vertexCount, threadCount);
+			MIntArray vertexList(indices.data(), vertexCount);
+
+			if(!mesh.normals.empty())
+			{
+				MVectorArray normalArray(reinterpret_cast<const float(*)[3]>(mesh.normals.data()), vertexCount);
+				CHECK_MSTATUS(meshFn.setVertexNormals(normalArray, vertexList));
+			}
+			if(!mesh.colors.empty())
+			{
+				MColorArray colorArray = to_color_array(mesh.colors, mesh.colorChannels, threadCount);
+				CHECK_MSTATUS(meshFn.setVertexColors(colorArray, vertexList));
+			}
+		}
+
+		if(!mesh.faceColors.empty())
+		{
+			std::vector<int> indices = make_index_list(faceCount, threadCount);
+			MIntArray faceList(indices.data(), faceCount);
+			MColorArray colorArray = to_color_array(mesh.faceColors, mesh.faceColorChannels, threadCount);
+			CHECK_MSTATUS(meshFn.setFaceColors(colorArray, faceList));
+		}
+
+		std::vector<float> u;
+		std::vector<float> v;
+		if(!mesh.cornerUVs.empty())
+		{
+			// One uv per face corner, listed in corner order. 
+			split_uvs(mesh.cornerUVs, u, v, threadCount);
+			std::vector<int> uvIds = make_index_list(cornerCount, threadCount);
+			CHECK_MSTATUS(meshFn.setUVs(MFloatArray(u.data(), cornerCount), MFloatArray(v.data(), cornerCount)));
+			CHECK_MSTATUS(meshFn.assignUVs(polygonCounts, MIntArray(uvIds.data(), cornerCount)));
+		}
+		else if(!mesh.vertexUVs.empty())
+		{
+			split_uvs(mesh.vertexUVs, u, v, threadCount);
+			CHECK_MSTATUS(meshFn.setUVs(MFloatArray(u.data(), vertexCount), MFloatArray(v.data(), vertexCount)));
+			CHECK_MSTATUS(meshFn.assignUVs(polygonCounts, polygonConnects));
+		}
+		return meshObject;
+	}
+
+	// Copies width values per listed row of src, in list order. 
+	template<typename T>
+	void gather_rows(const std::vector<T>& src, size_t width, const std::vector<uint32_t>& rows, std::vector<T>& dst, unsigned int threadCount = 1)
+	{
+		if(src.empty()) return;
+		dst.resize(rows.size() * width);
+		tinyply::parallel_for(rows.size(), threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+		{
+			for(size_t i=first; i<last; ++i)
+			{
+				const T* row = src.data() + rows[i] * width;
+				std::copy(row, row + width, dst.data() + i * width);
+			}
+		});
+	}
+
+	// Cuts the arrays of one tile out of the whole mesh; the tile gives up
+	// its connectivity to the result. 
+	void gather_tile(const MeshArrays& mesh, const std::vector<uint32_t>& faceOffsets, MeshTile& tile, MeshArrays& out)
+	{
+		out.colorChannels     = mesh.colorChannels;
+		out.faceColorChannels = mesh.faceColorChannels;
+		gather_rows(mesh.positions, 3, tile.vertices, out.positions);
+		gather_rows(mesh.normals, 3, tile.vertices, out.normals);
+		gather_rows(mesh.colors, mesh.colorChannels, tile.vertices, out.colors);
+		gather_rows(mesh.vertexUVs, 2, tile.vertices, out.vertexUVs);
+		gather_rows(mesh.polygonCounts, 1, tile.faces, out.polygonCounts);
+		gather_rows(mesh.faceColors, mesh.faceColorChannels, tile.faces, out.faceColors);
+
+		if(!mesh.cornerUVs.empty())
+		{
+			out.cornerUVs.reserve(tile.connects.size() * 2);
+			for(size_t i=0; i<tile.faces.size(); ++i)
+			{
+				const uint32_t face = tile.faces[i];
+				out.cornerUVs.insert(out.cornerUVs.end(), mesh.cornerUVs.begin() + faceOffsets[face] * 2, mesh.cornerUVs.begin() + faceOffsets[face + 1] * 2);
+			}
+		}
+		out.polygonConnects.swap(tile.connects);
+	}
+
+	// Merges duplicate vertices, typically of triangle soups where every face
+	// brings its own corners. Faces that collapse onto an edge or a point are
+	// dropped. Vertex attributes follow the first vertex of every group. 
+	void weld_mesh(MeshArrays& mesh, float epsilon, bool matchNormals, bool matchUVs, unsigned int threadCount)
+	{
+		timepoint before = now();
+		const size_t vertexCount = mesh.positions.size() / 3;
+		const size_t faceCount   = mesh.polygonCounts.size();
+
+		std::vector<uint32_t> remap;
+		std::vector<uint32_t> kept;
+		weld_vertices(mesh.positions.data(),
+					  (matchNormals && !mesh.normals.empty()) ? mesh.normals.data() : nullptr,
+					  (matchUVs && !mesh.vertexUVs.empty()) ? mesh.vertexUVs.data() : nullptr,
+					  vertexCount, epsilon, threadCount, remap, kept);
+
+		size_t droppedFaces = 0;
+		if(kept.size() < vertexCount)
+		{
+			MeshArrays welded;
+			gather_rows(mesh.positions, 3, kept, welded.positions, threadCount);
+			gather_rows(mesh.normals, 3, kept, welded.normals, threadCount);
+			gather_rows(mesh.colors, mesh.colorChannels, kept, welded.colors, threadCount);
+			gather_rows(mesh.vertexUVs, 2, kept, welded.vertexUVs, threadCount);
+			mesh.positions.swap(welded.positions);
+			mesh.normals.swap(welded.normals);
+			mesh.colors.swap(welded.colors);
+			mesh.vertexUVs.swap(welded.vertexUVs);
+			remap_indices(remap, mesh.polygonConnects.data(), mesh.polygonConnects.size(), threadCount);
+
+			std::vector<uint32_t> faceOffsets(faceCount + 1, 0);
+			for(size_t i=0; i<faceCount; ++i)
+			{
+				faceOffsets[i + 1] = faceOffsets[i] + static_cast<uint32_t>(mesh.polygonCounts[i]);
+			}
+
+			// A face collapsed when two of its neighbouring corners became one. 
+			std::vector<uint8_t> collapsed(faceCount, 0);
+			tinyply::parallel_for(faceCount, threadCount, kMinItemsPerTask, [&](size_t first, size_t last)
+			{
+				for(size_t i=first; i<last; ++i)
+				{
+					const int* corners = mesh.polygonConnects.data() + faceOffsets[i];
+					const int count = mesh.polygonCounts[i];
+					for(int c=0; c<count; ++c)
+					{
+						if(corners[c] == corners[(c + 1) % count]) collapsed[i] = 1;
+					}
+				}
+			});
+
+			for(size_t i=0; i<faceCount; ++i)
+			{
+				droppedFaces += collapsed[i];
+			}
+			if(droppedFaces > 0)
+			{
+				size_t faceOut   = 0;
+				size_t cornerOut = 0;
+				const int faceColorChannels = mesh.faceColorChannels;
+				for(size_t i=0; i<faceCount; ++i)
+				{
+					if(collapsed[i]) continue;
+					const size_t count = static_cast<size_t>(mesh.polygonCounts[i]);
+					std::copy(mesh.polygonConnects.begin() + faceOffsets[i], mesh.polygonConnects.begin() + faceOffsets[i] + count, mesh.polygonConnects.begin() + cornerOut);
+					if(!mesh.cornerUVs.empty())
+					{
+						std::copy(mesh.cornerUVs.begin() + faceOffsets[i] * 2, mesh.cornerUVs.begin() + (faceOffsets[i] + count) * 2, mesh.cornerUVs.begin() + cornerOut * 2);
+					}
+					if(!mesh.faceColors.empty())
+					{
+						std::copy(mesh.faceColors.begin() + i * faceColorChannels, mesh.faceColors.begin() + (i + 1) * faceColorChannels, mesh.faceColors.begin() + faceOut * faceColorChannels);
+					}
+					mesh.polygonCounts[faceOut++] = static_cast<int>(count);
+					cornerOut += count;
+				}
+				mesh.polygonCounts.resize(faceOut);
+				mesh.polygonConnects.resize(cornerOut);
+				if(!mesh.cornerUVs.empty()) mesh.cornerUVs.resize(cornerOut * 2);
+				if(!mesh.faceColors.empty()) mesh.faceColors.resize(faceOut * faceColorChannels);
+			}
+		}
+		timepoint after = now();
+
+		std::ostringstream report;
+		report << "Welded " << vertexCount << " vertices into " << kept.size();
+		if(vertexCount > 0)
+		{
+			report << " (" << (100.0 * kept.size() / vertexCount) << "%)";
+		}
+		report << ", dropped " << droppedFaces << " collapsed faces in " << (difference_micros(before, after) / 1000.0) << " ms.";
+		MGlobal::displayInfo(report.str().c_str());
+
+		IoStats& stats = last_io_stats();
+		stats.add_time("weld", difference_micros(before, after) / 1000.0);
+		stats.add("weldedVertices", static_cast<int64_t>(vertexCount - kept.size()));
+		stats.add("droppedFaces", static_cast<int64_t>(droppedFaces));
+	}
+
+	// Splits the mesh into octree tiles of at most maxFaces faces. The tile
+	// arrays are cut in parallel; the Maya nodes are then created on this
+	// thread, one transform per tile under a shared group. 
+	MStatus import_tiled_mesh(const MeshArrays& mesh, size_t maxFaces, unsigned int threadCount)
+	{
+		IoStats& stats = last_io_stats();
+		IoStats::Phase tilePhase(stats, "tiles");
+		std::vector<uint32_t> faceOffsets(mesh.polygonCounts.size() + 1, 0);
+		for(size_t i=0; i<mesh.polygonCounts.size(); ++i)
+		{
+			faceOffsets[i + 1] = faceOffsets[i] + static_cast<uint32_t>(mesh.polygonCounts[i]);
+		}
+
+		std::vector<MeshTile> tiles;
+		build_mesh_tiles(mesh.positions.data(), mesh.positions.size() / 3, faceOffsets.data(), mesh.polygonCounts.size(), mesh.polygonConnects.data(), maxFaces, threadCount, tiles);
+
+		std::vector<MeshArrays> tileArrays(tiles.size());
+		tinyply::parallel_for(tiles.size(), threadCount, 1, [&](size_t first, size_t last)
+		{
+			for(size_t i=first; i<last; ++i)
+			{
+				gather_tile(mesh, faceOffsets, tiles[i], tileArrays[i]);
+			}
+		});
+
+#ifdef _DEBUG
+		std::cerr << "\tSplit " << mesh.polygonCounts.size() << " faces into " << tiles.size() << " tiles." << std::endl;
+#endif
+		tilePhase.stop();
+		stats.add("tiles", static_cast<int64_t>(tiles.size()));
+
+		IoStats::Phase createPhase(stats, "create");
+		MStatus stat;
+		MFnTransform groupFn;
+		MObject group = groupFn.create(MObject::kNullObj, &stat);
+		CHECK_MSTATUS_AND_RETURN_IT(stat);
+		groupFn.setName("ply_tiles");
+
+		for(size_t i=0; i<tileArrays.size(); ++i)
+		{
+			MFnTransform tileFn;
+			MObject transform = tileFn.create(group, &stat);
+			CHECK_MSTATUS_AND_RETURN_IT(stat);
+			MString tileName("tile_");
+			tileName += static_cast<int>(i);
+			tileFn.setName(tileName);
+
+			create_mesh(tileArrays[i], transform, threadCount, &stat);
+			if(!stat)
+			{
+				return stat;
+			}
+			tileArrays[i] = MeshArrays();
+		}
+		return MS::kSuccess;
+	}
+
+	// Raw arrays of one mesh as returned by the bulk MFnMesh queries. 
+	struct MeshExtract
+	{
+		std::vector<float> points;              // xyzw, world space
+		std::vector<float> normals;             // xyz per vertex, world space
+		std::vector<float> colors;              // rgba per vertex
+		std::vector<int>   faceVertexCounts;
+		std::vector<int>   faceVertices;
+		std::vector<int>   faceCornerStarts;    // first corner of each face
+		std::vector<int>   triangleStarts;      // first triangle of each face
+		std::vector<int>   triangleCounts;
+		std::vector<int>   triangleCorners;     // face relative corner per triangle vertex
+		std::vector<int>   uvCounts;
+		std::vector<int>   uvIds;
+		std::vector<float> u;
+		std::vector<float> v;
+		std::vector<int>   vertexUVIds;         // the one uv of each vertex, -1 for none
+		bool   seamlessUVs;                     // every corner of a vertex has its uv
+		size_t triangleCount;
+		size_t vertexBase;
+		size_t triangleBase;
+
+		size_t vertexCount() const { return points.size() / 4; }
+	};
+
+	struct PackTask
+	{
+		size_t mesh;
+		bool   faces;
+		size_t first;
+		size_t last;
+	};
+
+	void copy_int_array(const MIntArray& src, std::vector<int>& dst)
+	{
+		dst.resize(src.length());
+		if (!dst.empty())
+		{
+			src.get(dst.data());
+		}
+	}
+
+	void copy_float_array(const MFloatArray& src, std::vector<float>& dst)
+	{
+		dst.resize(src.length());
+		if (!dst.empty())
+		{
+			src.get(dst.data());
+		}
+	}
+
+	// Exclusive prefix sum of counts. 
+	size_t prefix_sum(const std::vector<int>& counts, std::vector<int>& starts)
+	{
+		starts.resize(counts.size());
+		size_t total = 0;
+		for (size_t i = 0; i < counts.size(); ++i)
+		{
+			starts[i] = static_cast<int>(total);
+			total += counts[i];
+		}
+		return total;
+	}
+
+	MStatus extract_mesh(const MDagPath& dagPath, MeshExtract& mesh)
+	{
+		MStatus status;
+		MFnMesh fnMesh(dagPath, &status);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+
+		MPointArray points;
+		status = fnMesh.getPoints(points, MSpace::kWorld);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		mesh.points.resize(points.length() * 4);
+		if (!mesh.points.empty())
+		{
+			points.get(reinterpret_cast<float(*)[4]>(mesh.points.data()));
+		}
+
+		MFloatVectorArray normals;
+		status = fnMesh.getVertexNormals(false, normals, MSpace::kWorld);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		mesh.normals.resize(normals.length() * 3);
+		if (!mesh.normals.empty())
+		{
+			normals.get(reinterpret_cast<float(*)[3]>(mesh.normals.data()));
+		}
+
+		MColorArray colors;
+		fnMesh.getVertexColors(colors);
+		mesh.colors.resize(colors.length() * 4);
+		if (!mesh.colors.empty())
+		{
+			colors.get(reinterpret_cast<float(*)[4]>(mesh.colors.data()));
+		}
+
+		MIntArray counts, indices;
+		status = fnMesh.getVertices(counts, indices);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		copy_int_array(counts, mesh.faceVertexCounts);
+		copy_int_array(indices, mesh.faceVertices);
+
+		// Maya's own triangulation, as corners relative to each face. 
+		status = fnMesh.getTriangleOffsets(counts, indices);
+		CHECK_MSTATUS_AND_RETURN_IT(status);
+		copy_int_array(counts, mesh.triangleCounts);
+		copy_int_array(indices, mesh.triangleCorners);
+
+		fnMesh.getAssignedUVs(counts, indices);
+		copy_int_array(counts, mesh.uvCounts);
+		copy_int_array(indices, mesh.uvIds);
+
+		MFloatArray u, v;
+		fnMesh.getUVs(u, v);
+		copy_float_array(u, mesh.u);
+		copy_float_array(v, mesh.v);
+
+		prefix_sum(mesh.faceVertexCounts, mesh.faceCornerStarts);
+		mesh.triangleCount = prefix_sum(mesh.triangleCounts, mesh.triangleStarts);
+
+		// Uvs can be written per vertex when no vertex is split by a seam,
+		// i.e. all corners of a vertex use the same uv. 
+		mesh.vertexUVIds.assign(mesh.vertexCount(), -1);
+		mesh.seamlessUVs = !mesh.u.empty() && mesh.uvCounts == mesh.faceVertexCounts;
+		for (size_t c = 0; mesh.seamlessUVs && c < mesh.faceVertices.size(); ++c)
+		{
+			const int uvId = mesh.uvIds[c];
+			int& vertexUVId = mesh.vertexUVIds[mesh.faceVertices[c]];
+			if (vertexUVId < 0)
+			{
+				vertexUVId = uvId;
+			}
+			else if (vertexUVId != uvId && (mesh.u[vertexUVId] != mesh.u[uvId] || mesh.v[vertexUVId] != mesh.v[uvId]))
+			{
+				mesh.seamlessUVs = false;
+			}
+		}
+		return MS::kSuccess;
+	}
+
+	inline uint8_t to_color_byte(float value)
+	{
+		return static_cast<uint8_t>(std::min(std::max(value, 0.0f), 1.0f) * 255);
+	}
+
+	// uvs is null unless uvs are written per vertex. 
+	void pack_vertices(const MeshExtract& mesh, size_t first, size_t last, float* verts, float* norms, uint8_t* colors, float* uvs)
+	{
+		const bool hasNormals = mesh.normals.size() == mesh.vertexCount() * 3;
+		const bool hasColors  = mesh.colors.size()  == mesh.vertexCount() * 4;
+		for (size_t i = first; i < last; ++i)
+		{
+			const size_t o = mesh.vertexBase + i;
+			verts[o*3]   = mesh.points[i*4];
+			verts[o*3+1] = mesh.points[i*4+1];
+			verts[o*3+2] = mesh.points[i*4+2];
+
+			norms[o*3]   = hasNormals ? mesh.normals[i*3]   : 0.0f;
+			norms[o*3+1] = hasNormals ? mesh.normals[i*3+1] : 0.0f;
+			norms[o*3+2] = hasNormals ? mesh.normals[i*3+2] : 0.0f;
+
+			MColor vColor = hasColors ? MColor(mesh.colors[i*4], mesh.colors[i*4+1], mesh.colors[i*4+2], mesh.colors[i*4+3]) : MColor(0.0f, 0.0f, 0.0f, 0.0f);
+			if (vColor.r <= 0.001 && vColor.g <= 0.001 && vColor.b <= 0.001)
+			{
+				vColor = MColor(0.5, 0.5, 0.5, 1.0);
+			}
+			colors[o*4]   = to_color_byte(vColor.r);
+			colors[o*4+1] = to_color_byte(vColor.g);
+			colors[o*4+2] = to_color_byte(vColor.b);
+			colors[o*4+3] = to_color_byte(vColor.a);
+
+			if (uvs)
+			{
+				const int uvId = mesh.vertexUVIds[i];
+				uvs[o*2]   = (uvId >= 0) ? mesh.u[uvId] : 0.0f;
+				uvs[o*2+1] = (uvId >= 0) ? mesh.v[uvId] : 0.0f;
+			}
+		}
+	}
+
+	// faceTexcoords is null unless uvs are written per face corner. 
+	void pack_faces(const MeshExtract& mesh, size_t first, size_t last, int32_t* vertexIndicies, float* faceTexcoords)
+	{
+		const bool hasUVs = mesh.uvCounts.size() == mesh.faceVertexCounts.size() && !mesh.u.empty();
+		for (size_t f = first; f < last; ++f)
+		{
+			const int cornerStart = mesh.faceCornerStarts[f];
+			const bool faceHasUVs = hasUVs && mesh.uvCounts[f] == mesh.faceVertexCounts[f];
+			size_t t   = mesh.triangleStarts[f];
+			size_t out = mesh.triangleBase + t;
+			for (int n = 0; n < mesh.triangleCounts[f]; ++n, ++t, ++out)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					const int corner = cornerStart + mesh.triangleCorners[t*3+k];
+					vertexIndicies[out*3+k] = static_cast<int32_t>(mesh.vertexBase + mesh.faceVertices[corner]);
+
+					if (faceTexcoords)
+					{
+						const int uvId = faceHasUVs ? mesh.uvIds[corner] : -1;
+						faceTexcoords[out*6+k*2]   = (uvId >= 0) ? mesh.u[uvId] : 0.0f;
+						faceTexcoords[out*6+k*2+1] = (uvId >= 0) ? mesh.v[uvId] : 0.0f;
+					}
+				}
+			}
+		}
+	}
+
 } // unnamed namespace 
 
+MObject create_ply_mesh(const MeshArrays& mesh, MObject parent, unsigned int threadCount, MStatus* status)
+{
+	return create_mesh(mesh, parent, threadCount, status);
+}
+
 MString const PlyTranslator::magic("ply");
 
 PlyTranslator::PlyTranslator()
@@ -78,149 +885,175 @@ MPxFileTranslator::MFileKind PlyTranslator::identifyFile(const MFileObject& file
 	{
 		rval = kIsMyFileType;
 	}
+	else if ((size > 0) &&
+		is_compressed_ply_name(fileName.resolvedName().asChar(), compression_from_magic(buffer, size)))
+	{	// The header is compressed; a .ply.gz or .ply.zst name has to do. 
+		rval = kIsMyFileType;
+	}
 	return rval;
 }
 
+
 MStatus PlyTranslator::reader(const MFileObject& file, const MString& optionsString, MPxFileTranslator::FileAccessMode mode)
 {
 	const MString fileName = file.fullName();
 	MStatus retval(MStatus::kSuccess);
 
+	const std::map<std::string, std::string> options = parse_options(optionsString);
+	// 0 uses every hardware thread. 
+	const unsigned int threadCount = static_cast<unsigned int>(option_as_int(options, "threads", 0));
+
+	StatsScope statsScope("import", fileName, options);
+	IoStats& stats = last_io_stats();
+
 	try
 	{
 		MStatus stat;
 
-		std::ifstream ss(std::string(fileName.asChar()), std::ios::binary);
-		tinyply::PlyFile file(ss);
-
-		uint32_t vertexCount = 0;
-		uint32_t normalCount = 0;
-		uint32_t colorCount  = 0;
-		uint32_t faceCount   = 0;
-		uint32_t uvCount     = 0;
-		uint32_t faceColorCount = 0;
-		uint32_t tristripCount = 0;
-
-		std::vector<float>      vertices;
-		std::vector<float>      normals;
-		std::vector<uint8_t>    colors;
-		std::vector<uint32_t>   faces;
-		std::vector<float>      uvCoords;
-		std::vector<uint8_t>    faceColors;
-		std::vector<int>        stripIndices;
-
-		vertexCount     = file.request_properties_from_element("vertex", {"x", "y", "z"},      vertices);
-		normalCount     = file.request_properties_from_element("vertex", { "nx", "ny", "nz" }, normals);
-		colorCount      = file.request_properties_from_element("vertex", { "red", "green", "blue", "alpha" }, colors);
-		faceCount       = file.request_properties_from_element("face",   { "vertex_indices" }, faces, 3);
-		uvCount         = file.request_properties_from_element("face",   { "texcoord" }, uvCoords);
-		faceColorCount  = file.request_properties_from_element("face",   { "red", "green", "blue", "alpha" }, faceColors);
-		tristripCount   = file.request_properties_from_element("tristrips", { "vertex_indices" }, stripIndices);
-
-		timepoint before = now();
-		file.read(ss);
-		timepoint after  = now();
-
-#ifdef _DEBUG
-		std::cerr << "Parsing took " << difference_micros(before, after) << "micro sec.: " << std::endl;
-		std::cerr << "\tRead " << vertices.size()   << " total vertices ("          << vertexCount << " properties)." << std::endl;
-		std::cerr << "\tRead " << normals.size()    << " total normals ("           << normalCount  << " properties)." << std::endl;
-		std::cerr << "\tRead " << colors.size()     << " total vertex colors ("     << colorCount << " properties)." << std::endl;
-		std::cerr << "\tRead " << faces.size()      << " total faces (triangles) (" << faceCount << " properties)." << std::endl;
-		std::cerr << "\tRead " << uvCoords.size()   << " total texcoords ("         << uvCount << " properties)." << std::endl;
-		std::cerr << "\tRead " << faceColors.size() << " total face colors ("       << faceColorCount << " properties)." << std::endl;
-		std::cerr << "\tRead " << stripIndices.size() << " total strip indices ("   << tristripCount << " properties)." << std::endl;
-		std::cerr << std::endl;
-#endif
-
-		// Convert mesh data. 
-		MPointArray cornerVertices;
-		for(uint32_t i=0; i<vertexCount; ++i)
+		// Meshes decoded before are taken from the geometry cache while the
+		// file keeps its size and modification time. 
+		const std::string path(fileName.asChar());
+		int64_t fileSize  = 0;
+		int64_t fileMtime = 0;
+		const bool useCache = option_as_int(options, "cache", 0) != 0 && file_stamp(path, &fileSize, &fileMtime);
+		GeometryCache::Entry mesh;
+		std::shared_ptr<MeshArrays> parsed;	// arrays read by this import
+		if(useCache)
 		{
-			cornerVertices.append(MPoint(vertices[i*3], vertices[i*3+1], vertices[i*3+2]));
+			IoStats::Phase cachePhase(stats, "cache");
+			mesh = geometry_cache().find(path, fileSize, fileMtime);
+			stats.add(mesh ? "cacheHits" : "cacheMisses", 1);
 		}
 
-		const int kNumVertexCountsPerPrimitive = 3;
-		MIntArray polygonConnects;
-		MIntArray polygonCounts;
-		MIntArray faceList;
-
-		if(faceCount)
+		if(!mesh)
 		{
-			for (uint32_t i = 0; i < faceCount; ++i)
-			{
-				polygonCounts.append(kNumVertexCountsPerPrimitive);
+			IoStats::Phase headerPhase(stats, "header");
+			const Compression compression = compression_of_file(path);
 
-				polygonConnects.append(faces[i * 3]);
-				polygonConnects.append(faces[i * 3 + 1]);
-				polygonConnects.append(faces[i * 3 + 2]);
+			// Compressed files are decoded from a stream that decompresses on a
+			// second thread; others straight from a read-only mapping of the file. 
+			std::unique_ptr<std::istream> is;
+			std::unique_ptr<tinyply::MemoryMappedFile> mappedFile;
+			if(compression != kUncompressed)
+			{
+				is.reset(new DecompressingStream(path, compression));
+			}
+			else
+			{
+				is.reset(new std::ifstream(path, std::ios::binary));
+			}
+			tinyply::PlyFile file(*is);
+			if(compression == kUncompressed)
+			{
+				is.reset();
+				mappedFile.reset(new tinyply::MemoryMappedFile(path));
+				stats.add("fileBytes", static_cast<int64_t>(mappedFile->size()));
+			}
+			headerPhase.stop();
+			stats.add("headerBytes", static_cast<int64_t>(file.get_header_size()));
 
-				faceList.append(i);
-				faceList.append(i);
-				faceList.append(i);
+			if(element_size(file, "vertex") > 0 && element_size(file, "face") == 0 && element_size(file, "tristrips") == 0)
+			{
+				const MStatus status = import_point_cloud(file, mappedFile.get(), is.get(), options, threadCount);
+				add_compressed_stats(stats, is.get());
+				return statsScope.finish(status);
 			}
-		}
-		else if(tristripCount > 0)
-		{
-			faceCount = 0;
-			uint32_t traceIndex = 2;
-			uint32_t tristripIndexCount = static_cast<uint32_t>(stripIndices.size());
-			int windings = 0;
 
-			while(tristripIndexCount > traceIndex)
+			PlyMeshData data;
+			request_mesh_data(file, data);
+
+			timepoint before = now();
+			if(mappedFile)
+			{
+				file.read(*mappedFile, threadCount);
+			}
+			else
 			{
-				int vindex0 = stripIndices[traceIndex - 2];
-				int vindex1 = stripIndices[traceIndex - 1];
-				int vindex2 = stripIndices[traceIndex];
+				file.read(*is, threadCount);
+			}
+			timepoint after  = now();
+			stats.add_time("decode", difference_micros(before, after) / 1000.0);
+			add_read_stats(stats, file.get_read_stats());
+			add_compressed_stats(stats, is.get());
+			is.reset();
 
-				if(vindex0 != vindex1 && vindex1 != vindex2 && vindex0 != vindex2
-				&& vindex0 >= 0 && vindex1 >= 0 && vindex2 >= 0)
-				{
-					polygonCounts.append(kNumVertexCountsPerPrimitive);
+#ifdef _DEBUG
+			std::cerr << "Parsing took " << difference_micros(before, after) << "micro sec.: " << std::endl;
+			std::cerr << "\tRead " << data.vertices.size()   << " total vertices ("          << data.vertexCount << " properties)." << std::endl;
+			std::cerr << "\tRead " << data.normals.size()    << " total normals ("           << data.normalCount  << " properties)." << std::endl;
+			std::cerr << "\tRead " << data.colors.size()     << " total vertex colors ("     << data.colorCount << " properties)." << std::endl;
+			std::cerr << "\tRead " << data.uvs.size()        << " total vertex uvs ("        << data.uvCount << " properties)." << std::endl;
+			std::cerr << "\tRead " << data.faces.size()      << " total face indices ("      << data.faceCount << " faces)." << std::endl;
+			std::cerr << "\tRead " << data.texcoords.size()  << " total texcoords ("         << data.texcoordCount << " faces)." << std::endl;
+			std::cerr << "\tRead " << data.faceColors.size() << " total face colors ("       << data.faceColorCount << " properties)." << std::endl;
+			std::cerr << "\tRead " << data.stripIndices.size() << " total strip indices ("   << data.tristripCount << " strips)." << std::endl;
+			std::cerr << std::endl;
+#endif
 
-					if((windings%2) == 0)
-					{
-						polygonConnects.append(vindex0);
-						polygonConnects.append(vindex1);
-						polygonConnects.append(vindex2);
-					}
-					else
-					{
-						polygonConnects.append(vindex2);
-						polygonConnects.append(vindex1);
-						polygonConnects.append(vindex0);
-					}
+			// Gather the mesh arrays; attributes are kept only when they cover
+			// every vertex or face. Maya arrays are built from them in one bulk
+			// copy each. 
+			IoStats::Phase polygonPhase(stats, "polygons");
+			parsed = std::make_shared<MeshArrays>();
+			if(build_mesh_arrays(data, *parsed, threadCount) == 0 || parsed->positions.empty())
+			{	// Invalid mesh was found... 
+				return statsScope.finish(retval);
+			}
+			polygonPhase.stop();
 
-					faceList.append(faceCount);
-					faceList.append(faceCount);
-					faceList.append(faceCount);
+			if(useCache)
+			{
+				IoStats::Phase cachePhase(stats, "cache");
+				geometry_cache().insert(path, fileSize, fileMtime, parsed);
+			}
+			mesh = parsed;
+		}
 
-					faceCount++;
-					windings++;
-				}
-				else
-				{
-					windings = 0;
-				}
-				traceIndex++;
+		uint32_t faceCount = static_cast<uint32_t>(mesh->polygonCounts.size());
+		stats.add("vertices", static_cast<int64_t>(mesh->positions.size() / 3));
+		stats.add("faces", faceCount);
+
+		// Arrays only this import holds are welded in place. Arrays the cache
+		// holds too are welded on a copy, so the cache keeps them as read. 
+		const MeshArrays* arrays = mesh.get();
+		MeshArrays copy;
+		if(option_as_int(options, "weld", 0) != 0)
+		{
+			MeshArrays* welded = &copy;
+			if(parsed)
+			{
+				mesh.reset();
+				if(parsed.use_count() == 1) welded = parsed.get();
+			}
+			if(welded == &copy) copy = *arrays;
+			weld_mesh(*welded,
+					  static_cast<float>(option_as_double(options, "weldEpsilon", 0.0)),
+					  option_as_int(options, "weldNormals", 1) != 0,
+					  option_as_int(options, "weldUVs", 1) != 0,
+					  threadCount);
+			arrays = welded;
+			faceCount = static_cast<uint32_t>(welded->polygonCounts.size());
+			if(faceCount == 0)
+			{
+				return statsScope.finish(retval);
 			}
 		}
 
-		if(vertexCount == 0 || faceCount == 0)
-		{	// Invalid mesh was found... 
-			return retval;
+		// Import mesh to scene, split into spatial tiles when it is larger
+		// than tileFaces. 
+		const size_t tileFaces = static_cast<size_t>(std::max(0, option_as_int(options, "tileFaces", 0)));
+		if(tileFaces > 0 && faceCount > tileFaces)
+		{
+			return statsScope.finish(import_tiled_mesh(*arrays, tileFaces, threadCount));
 		}
 
-		// Import mesh to scene. 
-		MFnMesh     meshFn;
-		meshFn.create(vertexCount,
-					  faceCount,
-					  cornerVertices,
-					  polygonCounts,
-					  polygonConnects,
-					  MObject::kNullObj,
-					  &stat);
-		CHECK_MSTATUS(stat);
+		IoStats::Phase createPhase(stats, "create");
+		create_mesh(*arrays, MObject::kNullObj, threadCount, &stat);
+		if(!stat)
+		{
+			return statsScope.finish(stat);
+		}
+		statsScope.finish(retval);
 	}
 	catch (const std::exception& e)
 	{
@@ -232,18 +1065,52 @@ MStatus PlyTranslator::reader(const MFileObject& file, const MString& optionsStr
 
 MStatus PlyTranslator::writer(const MFileObject& file, const MString& optionsString, MPxFileTranslator::FileAccessMode mode)
 {
-	
+	MStatus status;
 
-	MStatus status;
-	MVector vNormal;
-	MColor vColor;
-	float2 uvPoint;
-
-	std::vector<float> verts;
-	std::vector<float> norms;
-	std::vector<uint8_t> colors;
-	std::vector<int32_t> vertexIndicies;
-	std::vector<float> faceTexcoords;
+	const std::map<std::string, std::string> options = parse_options(optionsString);
+	const unsigned int threadCount = static_cast<unsigned int>(option_as_int(options, "threads", 0));
+	const std::string format = option_as_string(options, "format", "binary_little_endian");
+	if(format != "ascii" && format != "binary_little_endian" && format != "binary_big_endian")
+	{
+		MGlobal::displayError(MString("Unknown ply format: ") + format.c_str());
+		return MS::kFailure;
+	}
+
+	// Compact encodings. compact=1 picks the lossless ones: the smallest
+	// index type, per-vertex uvs when there are no seams, no opaque alpha.
+	// Quantized positions and normals have to be asked for. 
+	const bool compact = option_as_int(options, "compact", 0) != 0;
+	const std::string indexType    = option_as_string(options, "indexType", compact ? "auto" : "int");
+	const std::string positionType = option_as_string(options, "positionType", "float");
+	const std::string normalType   = option_as_string(options, "normalType", "float");
+	const std::string uvLayout     = option_as_string(options, "uvs", compact ? "auto" : "face");
+	if((indexType != "auto" && indexType != "int" && indexType != "uint" && indexType != "ushort") ||
+	   (positionType != "float" && positionType != "ushort") ||
+	   (normalType != "float" && normalType != "short" && normalType != "char") ||
+	   (uvLayout != "auto" && uvLayout != "face"))
+	{
+		MGlobal::displayError("Unknown ply encoding; indexType is auto|int|uint|ushort, positionType float|ushort, normalType float|short|char and uvs auto|face");
+		return MS::kFailure;
+	}
+
+	// Output is compressed as the compression option says, by default as the
+	// .gz or .zst extension of the file says. 
+	Compression compression = compression_from_extension(file.fullName().asChar());
+	const std::string compressionName = option_as_string(options, "compression", compression_name(compression));
+	if(!compression_from_name(compressionName, &compression))
+	{
+		MGlobal::displayError(MString("Unknown ply compression: ") + compressionName.c_str());
+		return MS::kFailure;
+	}
+	if(!compression_supported(compression))
+	{
+		MGlobal::displayError(MString("This build cannot write ") + compression_name(compression) + " compressed ply files");
+		return MS::kFailure;
+	}
+
+	StatsScope statsScope("export", file.fullName(), options);
+	IoStats& stats = last_io_stats();
+	IoStats::Phase extractPhase(stats, "extract");
 
 	MSelectionList slist;
 	MGlobal::getActiveSelectionList(slist);
@@ -255,9 +1122,13 @@ MStatus PlyTranslator::writer(const MFileObject& file, const MString& optionsStr
 	}
 
 	// We will need to interate over a selected node's heirarchy 
-	// in the case where shapes are grouped, and the group is selected.
+	// in the case where shapes are grouped, and the group is selected. 
 	MItDag dagIterator(MItDag::kDepthFirst, MFn::kInvalid, &status);
 
+	// Pull every mesh out of Maya with the bulk MFnMesh calls first; the
+	// conversion afterwards no longer touches the Maya API. 
+	std::vector<MeshExtract> meshes;
+
 	// Selection list loop
 	for (; !iter.isDone(); iter.next())
 	{
@@ -265,7 +1136,7 @@ MStatus PlyTranslator::writer(const MFileObject& file, const MString& optionsStr
 		// get the selected node
 		status = iter.getDagPath(objectPath);
 
-		// reset iterator's root node to be the selected node.
+		// reset iterator's root node to be the selected node. 
 		status = dagIterator.reset(objectPath.node(),
 			MItDag::kDepthFirst, MFn::kInvalid);
 
@@ -273,7 +1144,6 @@ MStatus PlyTranslator::writer(const MFileObject& file, const MString& optionsStr
 		for (; !dagIterator.isDone(); dagIterator.next())
 		{
 			MDagPath dagPath;
-			MObject  component = MObject::kNullObj;
 			status = dagIterator.getPath(dagPath);
 
 			if (!status) {
@@ -281,101 +1151,230 @@ MStatus PlyTranslator::writer(const MFileObject& file, const MString& optionsStr
 				return MS::kFailure;
 			}
 
-			if (status)
+			// skip over intermediate objects
+			MFnDagNode dagNode(dagPath, &status);
+			if (dagNode.isIntermediateObject())
 			{
-				// skip over intermediate objects
-				MFnDagNode dagNode(dagPath, &status);
-				if (dagNode.isIntermediateObject())
-				{
-					continue;
-				}
-
-				if (dagPath.hasFn(MFn::kNurbsSurface))
-				{
-					status = MS::kSuccess;
-					fprintf(stderr, "Warning: skipping Nurbs Surface.\n");
-				}
-				else if ((dagPath.hasFn(MFn::kMesh)) &&
-					(dagPath.hasFn(MFn::kTransform)))
-				{
-					continue;
-				}
-				else if (dagPath.hasFn(MFn::kMesh))
+				continue;
+			}
+
+			if (dagPath.hasFn(MFn::kNurbsSurface))
+			{
+				status = MS::kSuccess;
+				fprintf(stderr, "Warning: skipping Nurbs Surface.\n");
+			}
+			else if ((dagPath.hasFn(MFn::kMesh)) &&
+				(dagPath.hasFn(MFn::kTransform)))
+			{
+				continue;
+			}
+			else if (dagPath.hasFn(MFn::kMesh))
+			{
+				meshes.push_back(MeshExtract());
+				status = extract_mesh(dagPath, meshes.back());
+				if (!status)
 				{
-					MFnMesh fnMesh(dagPath);
-					int numVertices = fnMesh.numVertices();
-					MItMeshVertex vertIter(dagPath);
-
-					for (; !vertIter.isDone(); vertIter.next())
-					{
-						MPoint pnt = vertIter.position(MSpace::kWorld);
-						verts.push_back((float)pnt.x);
-						verts.push_back((float)pnt.y);
-						verts.push_back((float)pnt.z);
-
-						vertIter.getNormal(vNormal);
-						norms.push_back((float)vNormal.x);
-						norms.push_back((float)vNormal.y);
-						norms.push_back((float)vNormal.z);
-
-						vertIter.getColor(vColor);
-						if (vColor.r <= 0.001 && vColor.g <= 0.001 && vColor.b <= 0.001)
-						{
-							vColor = MColor(0.5, 0.5, 0.5, 1.0);
-						}
-						colors.push_back((uint8_t) (vColor.r * 255));
-						colors.push_back((uint8_t)(vColor.g * 255));
-						colors.push_back((uint8_t)(vColor.b * 255));
-						colors.push_back((uint8_t)(vColor.a * 255));
-					}
-
-					MItMeshPolygon faceIter(dagPath);
-					MIntArray faceVertices;
-
-					for (; !faceIter.isDone(); faceIter.next())
-					{
-						faceIter.getVertices(faceVertices);
-						if (faceVertices.length() >= 4) {
-							MGlobal::displayError("Mesh has faces with more than 3 sides!");
-							return MS::kFailure;
-						}
-
-						for (unsigned int p=0; p<faceVertices.length(); p++) {
-							vertexIndicies.push_back(faceVertices[p]);
-							
-							faceIter.getUV(faceVertices[p], uvPoint);
-							faceTexcoords.push_back(uvPoint[0]);
-							faceTexcoords.push_back(uvPoint[1]);
-						}
-					}
+					MGlobal::displayError("Failed to read mesh " + dagPath.fullPathName());
+					return status;
 				}
 			}
 		}
 	}
 
-	// Tinyply does not perform any file i/o internally
-	MString fileName = file.fullName(), unitName;
-	std::filebuf fb;
-	fb.open(fileName.asChar(), std::ios::out | std::ios::binary);
-	std::ostream outputStream(&fb);
+	extractPhase.stop();
+	stats.add("meshes", static_cast<int64_t>(meshes.size()));
+
+	// Place every mesh in the output buffers. 
+	IoStats::Phase packPhase(stats, "pack");
+	size_t vertexTotal   = 0;
+	size_t triangleTotal = 0;
+	for (size_t m = 0; m < meshes.size(); ++m)
+	{
+		meshes[m].vertexBase   = vertexTotal;
+		meshes[m].triangleBase = triangleTotal;
+		vertexTotal   += meshes[m].vertexCount();
+		triangleTotal += meshes[m].triangleCount;
+	}
+
+	// With uvs=auto, uvs go per vertex when no mesh has seams, and are left
+	// out when no mesh has any. 
+	bool anyUVs      = false;
+	bool allSeamless = true;
+	for (size_t m = 0; m < meshes.size(); ++m)
+	{
+		anyUVs      = anyUVs || !meshes[m].u.empty();
+		allSeamless = allSeamless && (meshes[m].seamlessUVs || meshes[m].u.empty());
+	}
+	const bool writeVertexUVs = uvLayout == "auto" && anyUVs && allSeamless;
+	const bool writeFaceUVs   = uvLayout == "face" || (anyUVs && !allSeamless);
+
+	std::vector<float> verts(vertexTotal * 3);
+	std::vector<float> norms(vertexTotal * 3);
+	std::vector<uint8_t> colors(vertexTotal * 4);
+	std::vector<float> vertexUVs(writeVertexUVs ? vertexTotal * 2 : 0);
+	std::vector<int32_t> vertexIndicies(triangleTotal * 3);
+	std::vector<float> faceTexcoords(writeFaceUVs ? triangleTotal * 6 : 0);
+
+	// Split vertices and faces of all meshes into tasks so small meshes are
+	// packed side by side and large ones are spread across threads. 
+	std::vector<PackTask> tasks;
+	for (size_t m = 0; m < meshes.size(); ++m)
+	{
+		const size_t vertexCount = meshes[m].vertexCount();
+		for (size_t first = 0; first < vertexCount; first += kMinItemsPerTask)
+		{
+			PackTask task = { m, false, first, std::min(vertexCount, first + kMinItemsPerTask) };
+			tasks.push_back(task);
+		}
+		const size_t faceCount = meshes[m].faceVertexCounts.size();
+		for (size_t first = 0; first < faceCount; first += kMinItemsPerTask)
+		{
+			PackTask task = { m, true, first, std::min(faceCount, first + kMinItemsPerTask) };
+			tasks.push_back(task);
+		}
+	}
+
+	tinyply::parallel_for(tasks.size(), threadCount, 1, [&](size_t first, size_t last)
+	{
+		for (size_t t = first; t < last; ++t)
+		{
+			const PackTask& task = tasks[t];
+			if (task.faces)
+			{
+				pack_faces(meshes[task.mesh], task.first, task.last, vertexIndicies.data(), writeFaceUVs ? faceTexcoords.data() : nullptr);
+			}
+			else
+			{
+				pack_vertices(meshes[task.mesh], task.first, task.last, verts.data(), norms.data(), colors.data(), writeVertexUVs ? vertexUVs.data() : nullptr);
+			}
+		}
+	});
+	std::vector<MeshExtract>().swap(meshes);
+	packPhase.stop();
+	stats.add("vertices", static_cast<int64_t>(vertexTotal));
+	stats.add("triangles", static_cast<int64_t>(triangleTotal));
+	stats.add("bufferBytes", static_cast<int64_t>(verts.size() * sizeof(float) + norms.size() * sizeof(float) + colors.size() + vertexUVs.size() * sizeof(float) + vertexIndicies.size() * sizeof(int32_t) + faceTexcoords.size() * sizeof(float)));
+
+	MString fileName = file.fullName();
 
 	tinyply::PlyFile myFile;
-
-	myFile.add_properties_to_element("vertex", { "x", "y", "z" }, verts);
-	myFile.add_properties_to_element("vertex", { "nx", "ny", "nz" }, norms);
-	myFile.add_properties_to_element("vertex", { "red", "green", "blue", "alpha" }, colors);
-	myFile.add_properties_to_element("face", { "vertex_indices" }, vertexIndicies, 3, tinyply::PlyProperty::Type::UINT8);
-	myFile.add_properties_to_element("face", { "texcoord" }, faceTexcoords, 6, tinyply::PlyProperty::Type::UINT8);
 	myFile.comments.push_back("generated by tinyply");
 
-	std::ostringstream stream;
-	myFile.write(stream, true);
+	// The encoded arrays have to live until the file is written. 
+	IoStats::Phase encodePhase(stats, "encode");
+	std::vector<uint16_t> quantizedVerts;
+	std::vector<int16_t>  shortNorms;
+	std::vector<int8_t>   charNorms;
+	std::vector<uint16_t> ushortIndices;
+	std::vector<uint32_t> uintIndices;
 
-	outputStream << stream.str();
+	if (positionType == "ushort")
+	{
+		float boundsMin[3];
+		float boundsMax[3];
+		quantize_positions(verts, quantizedVerts, boundsMin, boundsMax, threadCount);
+		std::vector<float>().swap(verts);
+		myFile.comments.push_back(quantized_bounds_comment(boundsMin, boundsMax));
+		myFile.add_properties_to_element("vertex", { "x", "y", "z" }, quantizedVerts);
+	}
+	else
+	{
+		myFile.add_properties_to_element("vertex", { "x", "y", "z" }, verts);
+	}
 
-	fb.close();
+	if (normalType == "short")
+	{
+		quantize_normals(norms, shortNorms, threadCount);
+		std::vector<float>().swap(norms);
+		myFile.add_properties_to_element("vertex", { "nx", "ny", "nz" }, shortNorms);
+	}
+	else if (normalType == "char")
+	{
+		quantize_normals(norms, charNorms, threadCount);
+		std::vector<float>().swap(norms);
+		myFile.add_properties_to_element("vertex", { "nx", "ny", "nz" }, charNorms);
+	}
+	else
+	{
+		myFile.add_properties_to_element("vertex", { "nx", "ny", "nz" }, norms);
+	}
+
+	if (compact && drop_opaque_alpha(colors, threadCount) == 3)
+	{
+		myFile.add_properties_to_element("vertex", { "red", "green", "blue" }, colors);
+	}
+	else
+	{
+		myFile.add_properties_to_element("vertex", { "red", "green", "blue", "alpha" }, colors);
+	}
+
+	if (writeVertexUVs)
+	{
+		myFile.add_properties_to_element("vertex", { "u", "v" }, vertexUVs);
+	}
+
+	// ushort holds the indices of up to 65536 vertices. 
+	const bool fitsUshort = vertexTotal <= 65536;
+	if (indexType == "ushort" && !fitsUshort)
+	{
+		MGlobal::displayWarning("Too many vertices for ushort indices, writing int indices.");
+	}
+	if ((indexType == "auto" || indexType == "ushort") && fitsUshort)
+	{
+		narrow_indices(vertexIndicies, ushortIndices, threadCount);
+		std::vector<int32_t>().swap(vertexIndicies);
+		myFile.add_properties_to_element("face", { "vertex_indices" }, ushortIndices, 3, tinyply::PlyProperty::Type::UINT8);
+	}
+	else if (indexType == "uint")
+	{
+		narrow_indices(vertexIndicies, uintIndices, threadCount);
+		std::vector<int32_t>().swap(vertexIndicies);
+		myFile.add_properties_to_element("face", { "vertex_indices" }, uintIndices, 3, tinyply::PlyProperty::Type::UINT8);
+	}
+	else
+	{
+		myFile.add_properties_to_element("face", { "vertex_indices" }, vertexIndicies, 3, tinyply::PlyProperty::Type::UINT8);
+	}
+
+	if (writeFaceUVs)
+	{
+		myFile.add_properties_to_element("face", { "texcoord" }, faceTexcoords, 6, tinyply::PlyProperty::Type::UINT8);
+	}
+	encodePhase.stop();
+
+	// Records are interleaved into reusable blocks and written straight to
+	// the file, so the output is never held in memory as a whole. 
+	try
+	{
+		IoStats::Phase serializePhase(stats, "serialize");
+		if(compression != kUncompressed)
+		{
+			// Compression runs on its own thread while records are interleaved. 
+			CompressingSink sink(fileName.asChar(), compression, option_as_int(options, "compressionLevel", -1));
+			myFile.write(sink, format != "ascii", format == "binary_big_endian");
+			sink.close();
+			stats.add("fileBytes", static_cast<int64_t>(sink.compressed_bytes()));
+		}
+		else
+		{
+			tinyply::FileSink sink(fileName.asChar());
+			myFile.write(sink, format != "ascii", format == "binary_big_endian");
+			sink.close();
+		}
+		serializePhase.stop();
+
+		const tinyply::PlyWriteStats& written = myFile.get_write_stats();
+		stats.add("bytesWritten", static_cast<int64_t>(written.bytesWritten));
+		stats.add("elementsWritten", written.elementsWritten);
+		stats.add("recordsWritten", static_cast<int64_t>(written.recordsWritten));
+	}
+	catch (const std::exception& e)
+	{
+		MGlobal::displayError(MString("Failed to write ply file: ") + e.what());
+		return MS::kFailure;
+	}
 
-	return MStatus::kSuccess;
+	return statsScope.finish(MStatus::kSuccess);
 }
 
 void* PlyTranslator::creator()
@@ -68,3 +68,9 @@ private:
 
 }; // class PlyTranslator 
 
+struct MeshArrays;
+
+// Creates a Maya mesh from decoded arrays under parent, a new transform when
+// it is null. Used by plyImportBatch for the meshes parsed by its workers. 
+MObject create_ply_mesh(const MeshArrays& mesh, MObject parent, unsigned int threadCount, MStatus* status);
+
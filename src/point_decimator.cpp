@@ -0,0 +1,181 @@
+#include "point_decimator.h"
+#include "../external/tinyply/tinyply.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace
+{
+	// Below this many points per task a thread costs more than it saves. 
+	const size_t kMinPointsPerTask = 1 << 16;
+
+	inline int32_t voxel_coordinate(float value, double inverseSize)
+	{
+		const double cell = std::floor(value * inverseSize);
+		const double lo = static_cast<double>(std::numeric_limits<int32_t>::min());
+		const double hi = static_cast<double>(std::numeric_limits<int32_t>::max());
+		return static_cast<int32_t>(cell < lo ? lo : (cell > hi ? hi : cell));
+	}
+}
+
+PointDecimator::PointDecimator(Mode mode, uint64_t totalCount, uint64_t targetCount, double voxelSize, unsigned int seed)
+	: mode(mode)
+	, voxelSize(voxelSize)
+	, hasColors(false)
+	, remainingRecords(totalCount)
+	, remainingTargets(std::min(totalCount, targetCount))
+	, skip(0)
+	, random(seed)
+{
+	if(mode == kVoxel && !(voxelSize > 0.0))
+	{
+		this->mode = kKeepAll;
+	}
+	if(this->mode == kRandom)
+	{
+		skip = next_skip();
+	}
+}
+
+// Vitter's algorithm A: how many records to pass over before the next one is
+// taken, so that exactly remainingTargets of remainingRecords are selected
+// with equal probability using one random number per selected point. 
+uint64_t PointDecimator::next_skip()
+{
+	if(remainingTargets == 0)
+	{
+		return std::numeric_limits<uint64_t>::max();
+	}
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	const double v = uniform(random);
+	double top = static_cast<double>(remainingRecords - remainingTargets);
+	double records = static_cast<double>(remainingRecords);
+	double quot = top / records;
+	uint64_t s = 0;
+	while(quot > v)
+	{
+		++s;
+		top -= 1.0;
+		records -= 1.0;
+		quot *= top / records;
+	}
+	return s;
+}
+
+void PointDecimator::keep(const float* position, const uint8_t* color, int colorChannels)
+{
+	keptPositions.insert(keptPositions.end(), position, position + 3);
+	if(color)
+	{
+		keptColors.push_back(color[0]);
+		keptColors.push_back(color[1]);
+		keptColors.push_back(color[2]);
+		keptColors.push_back((colorChannels == 4) ? color[3] : 255);
+	}
+}
+
+void PointDecimator::add(const float* positions, const uint8_t* colors, int colorChannels, size_t count, unsigned int threadCount)
+{
+	hasColors = hasColors || (colors != nullptr);
+
+	if(mode == kKeepAll)
+	{
+		for(size_t i=0; i<count; ++i)
+		{
+			keep(positions + i*3, colors ? colors + i*colorChannels : nullptr, colorChannels);
+		}
+	}
+	else if(mode == kRandom)
+	{
+		size_t i = 0;
+		while(remainingTargets > 0)
+		{
+			if(skip >= count - i)
+			{
+				skip -= count - i;
+				remainingRecords -= count - i;
+				break;
+			}
+			i += static_cast<size_t>(skip);
+			remainingRecords -= skip;
+			keep(positions + i*3, colors ? colors + i*colorChannels : nullptr, colorChannels);
+			++i;
+			--remainingRecords;
+			--remainingTargets;
+			skip = next_skip();
+		}
+	}
+	else
+	{
+		// Cells are computed in parallel; only the table update is serial. 
+		chunkKeys.resize(count);
+		const double inverseSize = 1.0 / voxelSize;
+		tinyply::parallel_for(count, threadCount, kMinPointsPerTask, [&](size_t first, size_t last)
+		{
+			for(size_t i=first; i<last; ++i)
+			{
+				const float* p = positions + i*3;
+				VoxelKey key = { voxel_coordinate(p[0], inverseSize), voxel_coordinate(p[1], inverseSize), voxel_coordinate(p[2], inverseSize) };
+				chunkKeys[i] = key;
+			}
+		});
+
+		for(size_t i=0; i<count; ++i)
+		{
+			auto result = voxelIndex.insert(std::make_pair(chunkKeys[i], static_cast<uint32_t>(voxels.size())));
+			if(result.second)
+			{
+				VoxelSum empty = {};
+				voxels.push_back(empty);
+			}
+			VoxelSum& sum = voxels[result.first->second];
+			const float* p = positions + i*3;
+			sum.position[0] += p[0];
+			sum.position[1] += p[1];
+			sum.position[2] += p[2];
+			if(colors)
+			{
+				const uint8_t* c = colors + i*colorChannels;
+				sum.color[0] += c[0];
+				sum.color[1] += c[1];
+				sum.color[2] += c[2];
+				sum.color[3] += (colorChannels == 4) ? c[3] : 255;
+			}
+			sum.count++;
+		}
+	}
+}
+
+void PointDecimator::finish(std::vector<float>& positions, std::vector<uint8_t>& colors) const
+{
+	if(mode != kVoxel)
+	{
+		positions = keptPositions;
+		colors = hasColors ? keptColors : std::vector<uint8_t>();
+		return;
+	}
+
+	positions.resize(voxels.size() * 3);
+	colors.resize(hasColors ? voxels.size() * 4 : 0);
+	for(size_t i=0; i<voxels.size(); ++i)
+	{
+		const VoxelSum& sum = voxels[i];
+		const double scale = 1.0 / static_cast<double>(sum.count);
+		positions[i*3]   = static_cast<float>(sum.position[0] * scale);
+		positions[i*3+1] = static_cast<float>(sum.position[1] * scale);
+		positions[i*3+2] = static_cast<float>(sum.position[2] * scale);
+		if(hasColors)
+		{
+			for(int c=0; c<4; ++c)
+			{
+				colors[i*4+c] = static_cast<uint8_t>((sum.color[c] + sum.count / 2) / sum.count);
+			}
+		}
+	}
+}
+
+size_t PointDecimator::size() const
+{
+	return (mode == kVoxel) ? voxels.size() : keptPositions.size() / 3;
+}
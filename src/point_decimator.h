@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <unordered_map>
+
+// Reduces a stream of points to a bounded set while the points are being
+// read, so a cloud never has to be held in memory as a whole. Points arrive
+// in chunks of xyz positions with optional byte colors.
+class PointDecimator
+{
+public:
+
+	enum Mode
+	{
+		kKeepAll,	// every point is kept
+		kRandom,	// exactly min(targetCount, totalCount) uniformly chosen points
+		kVoxel		// one averaged point per occupied voxelSize cube
+	};
+
+	PointDecimator(Mode mode, uint64_t totalCount, uint64_t targetCount, double voxelSize, unsigned int seed = 0);
+
+	// colors holds colorChannels (3 or 4) bytes per point, or is null.
+	void add(const float* positions, const uint8_t* colors, int colorChannels, size_t count, unsigned int threadCount);
+
+	// Kept points as xyz positions and rgba colors.
+	void finish(std::vector<float>& positions, std::vector<uint8_t>& colors) const;
+
+	size_t size() const;
+
+private:
+
+	struct VoxelKey
+	{
+		int32_t x, y, z;
+		bool operator == (const VoxelKey& other) const { return x == other.x && y == other.y && z == other.z; }
+	};
+
+	struct VoxelKeyHash
+	{
+		size_t operator () (const VoxelKey& key) const
+		{
+			uint64_t h = static_cast<uint32_t>(key.x) * 0x9E3779B97F4A7C15ull;
+			h ^= static_cast<uint32_t>(key.y) * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+			h ^= static_cast<uint32_t>(key.z) * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+			return static_cast<size_t>(h ^ (h >> 32));
+		}
+	};
+
+	struct VoxelSum
+	{
+		double   position[3];
+		uint64_t color[4];
+		uint64_t count;
+	};
+
+	void keep(const float* position, const uint8_t* color, int colorChannels);
+	uint64_t next_skip();
+
+	Mode     mode;
+	double   voxelSize;
+	bool     hasColors;
+
+	// Selection sampling state: records left to see and points left to take.
+	uint64_t remainingRecords;
+	uint64_t remainingTargets;
+	uint64_t skip;
+	std::mt19937_64 random;
+
+	std::vector<float>   keptPositions;
+	std::vector<uint8_t> keptColors;
+
+	std::unordered_map<VoxelKey, uint32_t, VoxelKeyHash> voxelIndex;
+	std::vector<VoxelSum> voxels;
+	std::vector<VoxelKey> chunkKeys;
+};
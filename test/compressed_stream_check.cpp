@@ -0,0 +1,110 @@
+#include "../src/compressed_stream.h"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+// Writes compressed files through CompressingSink and reads them back with
+// DecompressingStream. The sizes are multiples of the 1 MB chunks the
+// decoders work in, so a stream ends exactly as an output chunk fills up.
+
+namespace
+{
+	const size_t kMegabyte = 1 << 20;
+
+	std::vector<uint8_t> make_data(size_t size, uint32_t seed)
+	{
+		std::vector<uint8_t> data(size);
+		uint32_t state = seed;
+		for(size_t i=0; i<size; ++i)
+		{
+			// Short runs keep the data compressible without being trivial.
+			if((i & 7) == 0) state = state * 1664525u + 1013904223u;
+			data[i] = static_cast<uint8_t>(state >> 24);
+		}
+		return data;
+	}
+
+	void write_compressed(const std::string& path, Compression compression, const std::vector<uint8_t>& data)
+	{
+		CompressingSink sink(path, compression, -1);
+		sink.write(data.data(), data.size());
+		sink.close();
+	}
+
+	std::vector<uint8_t> read_file(const std::string& path)
+	{
+		std::ifstream is(path.c_str(), std::ios::binary);
+		return std::vector<uint8_t>(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+	}
+
+	std::vector<uint8_t> read_decompressed(const std::string& path, Compression compression)
+	{
+		DecompressingStream is(path, compression);
+		return std::vector<uint8_t>(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+	}
+
+	bool check(const std::string& name, Compression compression, const std::vector<std::vector<uint8_t> >& members)
+	{
+		// Every member is compressed on its own and the files are joined,
+		// as concatenated gzip members are.
+		const std::string path = "compressed_stream_check.tmp";
+		std::vector<uint8_t> expected;
+		std::vector<uint8_t> compressed;
+		for(size_t i=0; i<members.size(); ++i)
+		{
+			write_compressed(path, compression, members[i]);
+			const std::vector<uint8_t> member = read_file(path);
+			compressed.insert(compressed.end(), member.begin(), member.end());
+			expected.insert(expected.end(), members[i].begin(), members[i].end());
+		}
+		{
+			std::ofstream os(path.c_str(), std::ios::binary | std::ios::trunc);
+			os.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+		}
+
+		bool ok = false;
+		try
+		{
+			ok = read_decompressed(path, compression) == expected;
+			if(!ok) std::cerr << name << ": decompressed data differs" << std::endl;
+		}
+		catch(const std::exception& e)
+		{
+			std::cerr << name << ": " << e.what() << std::endl;
+		}
+		std::remove(path.c_str());
+		return ok;
+	}
+}
+
+int main()
+{
+	const Compression compressions[] = { kGzip, kZstd };
+	const size_t sizes[] = { kMegabyte, 3 * kMegabyte, 3 * kMegabyte + 1 };
+
+	int failures = 0;
+	for(size_t c=0; c<2; ++c)
+	{
+		if(!compression_supported(compressions[c])) continue;
+		const std::string codec = compression_name(compressions[c]);
+		for(size_t s=0; s<3; ++s)
+		{
+			const std::string size = std::to_string(sizes[s]);
+			std::vector<std::vector<uint8_t> > members;
+			members.push_back(make_data(sizes[s], 1));
+			failures += check(codec + "/" + size, compressions[c], members) ? 0 : 1;
+			members.push_back(make_data(sizes[s], 2));
+			failures += check(codec + "/" + size + "x2", compressions[c], members) ? 0 : 1;
+		}
+	}
+	if(failures == 0)
+	{
+		std::cerr << "compressed_stream_check passed" << std::endl;
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,313 @@
+#include "../bench/synthetic_ply.h"
+#include "../external/tinyply/tinyply.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+// Reads synthetic ply files in every format through every read path and
+// thread count, into destinations of other types than the file, and checks
+// that they all decode the same values. Also pins down how values that do
+// not fit their destination are converted.
+
+namespace
+{
+	// Large enough for the parallel decoders to split the elements.
+	const uint64_t kVertexCount = 150000;
+	const size_t   kChunkRecords = 10007;
+
+	enum ReadPath
+	{
+		kStream,
+		kMapped,
+		kChunked,		// vertices only
+		kStreamChunked	// vertices only
+	};
+
+	const char* path_name(ReadPath path)
+	{
+		switch(path)
+		{
+		case kStream:        return "stream";
+		case kMapped:        return "mapped";
+		case kChunked:       return "chunked";
+		case kStreamChunked: return "stream_chunked";
+		}
+		return "";
+	}
+
+	// Every destination differs from the file: float positions come back as
+	// doubles, uchar colors normalized to floats, int indices as uint32.
+	struct Decoded
+	{
+		std::vector<double>   positions;
+		std::vector<float>    normals;
+		std::vector<float>    colors;
+		std::vector<float>    uvs;
+		std::vector<uint32_t> faceOffsets;
+		std::vector<uint32_t> faces;
+		std::vector<uint32_t> stripOffsets;
+		std::vector<int32_t>  strips;
+	};
+
+	template<typename T>
+	void append(std::vector<T>& all, const std::vector<T>& chunk)
+	{
+		all.insert(all.end(), chunk.begin(), chunk.end());
+	}
+
+	void read_decoded(const std::string& path, ReadPath readPath, unsigned int threads, Decoded& decoded)
+	{
+		std::ifstream is(path.c_str(), std::ios::binary);
+		tinyply::PlyFile file(is);
+
+		Decoded chunk;
+		const bool chunked = readPath == kChunked || readPath == kStreamChunked;
+		Decoded& target = chunked ? chunk : decoded;
+		file.request_properties_from_element("vertex", { "x", "y", "z" }, target.positions);
+		file.request_properties_from_element("vertex", { "nx", "ny", "nz" }, target.normals);
+		if(file.request_properties_from_element("vertex", { "red", "green", "blue" }, target.colors))
+		{
+			file.normalize_property("vertex", "red");
+			file.normalize_property("vertex", "green");
+			file.normalize_property("vertex", "blue");
+		}
+		file.request_properties_from_element("vertex", { "u", "v" }, target.uvs);
+		if(!chunked)
+		{
+			file.request_list_property_from_element("face", "vertex_indices", decoded.faceOffsets, decoded.faces);
+			file.request_list_property_from_element("tristrips", "vertex_indices", decoded.stripOffsets, decoded.strips);
+		}
+
+		auto append_chunk = [&](size_t, size_t)
+		{
+			append(decoded.positions, chunk.positions);
+			append(decoded.normals, chunk.normals);
+			append(decoded.colors, chunk.colors);
+			append(decoded.uvs, chunk.uvs);
+		};
+
+		switch(readPath)
+		{
+		case kStream:
+			file.read(is, threads);
+			break;
+		case kMapped:
+			{
+				tinyply::MemoryMappedFile mappedFile(path);
+				file.read(mappedFile, threads);
+			}
+			break;
+		case kChunked:
+			{
+				tinyply::MemoryMappedFile mappedFile(path);
+				file.read_chunked(mappedFile, "vertex", kChunkRecords, append_chunk, threads);
+			}
+			break;
+		case kStreamChunked:
+			file.read_chunked(is, "vertex", kChunkRecords, append_chunk, threads);
+			break;
+		}
+	}
+
+	class Checker
+	{
+	public:
+
+		Checker() : failures(0) {}
+
+		int failure_count() const { return failures; }
+
+		void fail(const std::string& name, const std::string& message)
+		{
+			std::cerr << name << ": " << message << std::endl;
+			++failures;
+		}
+
+		// Ascii bodies print reals with six significant digits.
+		template<typename T>
+		void compare(const std::string& name, const char* what, const std::vector<T>& actual, const std::vector<T>& expected, double tolerance = 0.0)
+		{
+			if(actual.size() != expected.size())
+			{
+				fail(name, std::string(what) + ": " + std::to_string(actual.size()) + " values instead of " + std::to_string(expected.size()));
+				return;
+			}
+			for(size_t i=0; i<actual.size(); ++i)
+			{
+				if(std::fabs(static_cast<double>(actual[i]) - static_cast<double>(expected[i])) > tolerance)
+				{
+					std::ostringstream message;
+					message << what << "[" << i << "] is " << actual[i] << " instead of " << expected[i];
+					fail(name, message.str());
+					return;
+				}
+			}
+		}
+
+	private:
+
+		int failures;
+	};
+
+	// The reference decode is checked against the grid the generator lays out.
+	void check_grid(Checker& checker, const std::string& name, const Decoded& decoded, const SyntheticPly& spec, const SyntheticPlyStats& stats)
+	{
+		const uint64_t width = std::max<uint64_t>(2, static_cast<uint64_t>(std::ceil(std::sqrt(static_cast<double>(spec.vertexCount)))));
+		std::vector<double> grid(stats.vertices * 3);
+		for(uint64_t i=0; i<stats.vertices; ++i)
+		{
+			const uint64_t x = i % width;
+			const uint64_t y = i / width;
+			grid[i*3]   = static_cast<double>(x);
+			grid[i*3+1] = static_cast<double>(y);
+			grid[i*3+2] = 0.25 * static_cast<double>((x * 7 + y * 13) % 17);
+		}
+		checker.compare(name, "grid positions", decoded.positions, grid);
+
+		if(spec.topology == SyntheticPly::kTriangles || spec.topology == SyntheticPly::kQuads)
+		{
+			const uint32_t corners = (spec.topology == SyntheticPly::kQuads) ? 4 : 3;
+			if(decoded.faceOffsets.size() != stats.faces + 1 || decoded.faceOffsets.back() != stats.faces * corners)
+			{
+				checker.fail(name, "face offsets do not match the face count");
+			}
+		}
+	}
+
+	void check_synthetic(Checker& checker, SyntheticPly::Topology topology)
+	{
+		SyntheticPly spec;
+		spec.vertexCount = kVertexCount;
+		spec.topology    = topology;
+		spec.normals     = true;
+		spec.colors      = true;
+		spec.uvs         = true;
+
+		const std::string path = "reader_check.ply";
+		Decoded reference;
+		SyntheticPlyStats stats = { 0, 0, 0 };
+
+		const SyntheticPly::Format formats[] = { SyntheticPly::kBinaryLittleEndian, SyntheticPly::kBinaryBigEndian, SyntheticPly::kAscii };
+		const ReadPath paths[] = { kMapped, kStream, kChunked, kStreamChunked };
+		const unsigned int threadCounts[] = { 1, 7 };
+		for(size_t f=0; f<3; ++f)
+		{
+			spec.format = formats[f];
+			stats = write_synthetic_ply(spec, path);
+			const double tolerance = (spec.format == SyntheticPly::kAscii) ? 1e-5 : 0.0;
+			for(size_t p=0; p<4; ++p)
+			for(size_t t=0; t<2; ++t)
+			{
+				const std::string name = std::string(topology_name(topology)) + "/" + format_name(spec.format) + "/" + path_name(paths[p]) + "/" + std::to_string(threadCounts[t]);
+				Decoded decoded;
+				try
+				{
+					read_decoded(path, paths[p], threadCounts[t], decoded);
+				}
+				catch(const std::exception& e)
+				{
+					checker.fail(name, e.what());
+					continue;
+				}
+				if(reference.positions.empty())
+				{
+					// Little endian, mapped, one thread.
+					check_grid(checker, name, decoded, spec, stats);
+					reference = decoded;
+					continue;
+				}
+				checker.compare(name, "positions", decoded.positions, reference.positions);
+				checker.compare(name, "normals", decoded.normals, reference.normals);
+				checker.compare(name, "colors", decoded.colors, reference.colors);
+				checker.compare(name, "uvs", decoded.uvs, reference.uvs, tolerance);
+				if(paths[p] == kMapped || paths[p] == kStream)
+				{
+					checker.compare(name, "face offsets", decoded.faceOffsets, reference.faceOffsets);
+					checker.compare(name, "faces", decoded.faces, reference.faces);
+					checker.compare(name, "strip offsets", decoded.stripOffsets, reference.stripOffsets);
+					checker.compare(name, "strips", decoded.strips, reference.strips);
+				}
+			}
+		}
+		std::remove(path.c_str());
+	}
+
+	// Integers going into narrower integers wrap as static_cast does, while
+	// reals are rounded and clamped to the destination range.
+	void check_narrowing(Checker& checker)
+	{
+		std::vector<int32_t> integers = { 32768, -32769, 65535, 1000 };
+		std::vector<float>   reals    = { 40000.0f, -40000.0f, 2.5f, -2.5f };
+		const std::vector<int16_t> wrapped = { -32768, 32767, -1, 1000 };
+		const std::vector<int16_t> clamped = { 32767, -32768, 3, -3 };
+
+		const std::string path = "reader_check_narrowing.ply";
+		for(int format=0; format<3; ++format)
+		{
+			const bool binary = format != 0;
+			const bool bigEndian = format == 2;
+			{
+				tinyply::PlyFile file;
+				file.add_properties_to_element("value", { "integer" }, integers);
+				file.add_properties_to_element("value", { "real" }, reals);
+				std::ofstream os(path.c_str(), std::ios::binary | std::ios::trunc);
+				file.write(os, binary, bigEndian);
+			}
+
+			const std::string name = std::string("narrowing/") + (binary ? (bigEndian ? "binary_big_endian" : "binary_little_endian") : "ascii");
+			for(int mapped=0; mapped<2; ++mapped)
+			{
+				std::vector<int16_t> fromIntegers;
+				std::vector<int16_t> fromReals;
+				try
+				{
+					std::ifstream is(path.c_str(), std::ios::binary);
+					tinyply::PlyFile file(is);
+					file.request_properties_from_element("value", { "integer" }, fromIntegers);
+					file.request_properties_from_element("value", { "real" }, fromReals);
+					if(mapped)
+					{
+						tinyply::MemoryMappedFile mappedFile(path);
+						file.read(mappedFile);
+					}
+					else
+					{
+						file.read(is);
+					}
+				}
+				catch(const std::exception& e)
+				{
+					checker.fail(name, e.what());
+					continue;
+				}
+				checker.compare(name + (mapped ? "/mapped" : "/stream"), "int32 to int16", fromIntegers, wrapped);
+				checker.compare(name + (mapped ? "/mapped" : "/stream"), "float to int16", fromReals, clamped);
+			}
+		}
+		std::remove(path.c_str());
+	}
+}
+
+int main()
+{
+	Checker checker;
+	const SyntheticPly::Topology topologies[] = { SyntheticPly::kPoints, SyntheticPly::kTriangles, SyntheticPly::kQuads, SyntheticPly::kStrips };
+	for(size_t t=0; t<4; ++t)
+	{
+		check_synthetic(checker, topologies[t]);
+	}
+	check_narrowing(checker);
+
+	if(checker.failure_count() == 0)
+	{
+		std::cerr << "reader_check passed" << std::endl;
+	}
+	return checker.failure_count() == 0 ? 0 : 1;
+}